@@ -0,0 +1,89 @@
+# SPIM benchmark: floating point.
+#
+# Double-precision dot products and Newton's method square roots.
+# Measures FP arithmetic, conversions, compares, and FP loads/stores.
+
+	.data
+	.align 3
+vec_a:	.space 8000
+vec_b:	.space 8000
+one:	.double 1.0
+half:	.double 0.5
+eps:	.double 1.0e-12
+
+	.text
+	.globl main
+main:
+	# vec_a[i] = i, vec_b[i] = 1 / (i + 1)
+	la $s0, vec_a
+	la $s1, vec_b
+	li $s2, 1000		# elements
+	l.d $f20, one
+	li $t0, 0
+init_loop:
+	mtc1 $t0, $f0
+	cvt.d.w $f0, $f0
+	sll $t1, $t0, 3
+	addu $t2, $s0, $t1
+	s.d $f0, 0($t2)
+	add.d $f2, $f0, $f20
+	div.d $f2, $f20, $f2
+	addu $t2, $s1, $t1
+	s.d $f2, 0($t2)
+	addiu $t0, $t0, 1
+	blt $t0, $s2, init_loop
+
+	# Sum of 100 dot products.
+	li $s3, 0		# pass
+	mtc1 $zero, $f12
+	cvt.d.w $f12, $f12
+dot_pass:
+	li $t0, 0
+dot_loop:
+	sll $t1, $t0, 3
+	addu $t2, $s0, $t1
+	l.d $f0, 0($t2)
+	addu $t2, $s1, $t1
+	l.d $f2, 0($t2)
+	mul.d $f4, $f0, $f2
+	add.d $f12, $f12, $f4
+	addiu $t0, $t0, 1
+	blt $t0, $s2, dot_loop
+	addiu $s3, $s3, 1
+	blt $s3, 100, dot_pass
+
+	li $v0, 3		# print sum
+	syscall
+	li $a0, 10
+	li $v0, 11
+	syscall
+
+	# Sum of square roots of 1..5000 by Newton's method.
+	l.d $f22, half
+	l.d $f24, eps
+	mtc1 $zero, $f12
+	cvt.d.w $f12, $f12
+	li $t0, 1
+sqrt_outer:
+	mtc1 $t0, $f0
+	cvt.d.w $f0, $f0	# x
+	mov.d $f2, $f0		# guess
+sqrt_inner:
+	div.d $f4, $f0, $f2
+	add.d $f4, $f4, $f2
+	mul.d $f4, $f4, $f22	# new guess
+	sub.d $f6, $f4, $f2
+	abs.d $f6, $f6
+	mov.d $f2, $f4
+	c.lt.d $f24, $f6
+	bc1t sqrt_inner
+	add.d $f12, $f12, $f2
+	addiu $t0, $t0, 1
+	ble $t0, 5000, sqrt_outer
+
+	li $v0, 3		# print sum
+	syscall
+	li $a0, 10
+	li $v0, 11
+	syscall
+	jr $ra
@@ -0,0 +1,36 @@
+# SPIM benchmark: integer ALU loop.
+#
+# Nested counting loops doing adds, shifts, logical operations, and
+# multiplies on registers only.  Measures raw instruction dispatch.
+
+	.text
+	.globl main
+main:
+	li $t0, 0		# outer counter
+	li $t2, 0		# checksum
+outer:
+	li $t1, 0		# inner counter
+inner:
+	addu $t2, $t2, $t1
+	sll $t3, $t1, 3
+	xor $t2, $t2, $t3
+	srl $t4, $t2, 5
+	or $t2, $t2, $t4
+	andi $t5, $t1, 0xff
+	mul $t6, $t5, $t0
+	subu $t2, $t2, $t6
+	addiu $t1, $t1, 1
+	slti $t7, $t1, 1000
+	bne $t7, $zero, inner
+
+	addiu $t0, $t0, 1
+	slti $t7, $t0, 500
+	bne $t7, $zero, outer
+
+	move $a0, $t2		# print checksum
+	li $v0, 1
+	syscall
+	li $a0, 10
+	li $v0, 11
+	syscall
+	jr $ra
@@ -0,0 +1,89 @@
+# SPIM benchmark: memory-heavy code.
+#
+# Sieve of Eratosthenes over a byte array, then repeated word-array
+# copies and sums.  Measures byte and word loads and stores in the data
+# segment.
+
+	.data
+sieve:	.space 200000
+src:	.space 40000
+dst:	.space 40000
+
+	.text
+	.globl main
+main:
+	# Sieve: sieve[i] = 1 marks i as composite.
+	la $s0, sieve
+	li $s1, 200000		# N
+	li $t0, 2		# i
+sieve_outer:
+	mul $t1, $t0, $t0
+	bge $t1, $s1, sieve_count
+	addu $t2, $s0, $t0
+	lbu $t3, 0($t2)
+	bne $t3, $zero, sieve_next
+	li $t4, 1
+sieve_inner:
+	addu $t2, $s0, $t1
+	sb $t4, 0($t2)
+	addu $t1, $t1, $t0
+	blt $t1, $s1, sieve_inner
+sieve_next:
+	addiu $t0, $t0, 1
+	j sieve_outer
+
+sieve_count:
+	li $t0, 2
+	li $s2, 0		# primes found
+count_loop:
+	addu $t2, $s0, $t0
+	lbu $t3, 0($t2)
+	bne $t3, $zero, count_next
+	addiu $s2, $s2, 1
+count_next:
+	addiu $t0, $t0, 1
+	blt $t0, $s1, count_loop
+
+	move $a0, $s2		# print number of primes
+	li $v0, 1
+	syscall
+	li $a0, 10
+	li $v0, 11
+	syscall
+
+	# Fill src, then copy it to dst and sum dst, several times.
+	la $s0, src
+	la $s1, dst
+	li $s3, 10000		# words
+	li $t0, 0
+fill_loop:
+	sll $t1, $t0, 2
+	addu $t1, $s0, $t1
+	sw $t0, 0($t1)
+	addiu $t0, $t0, 1
+	blt $t0, $s3, fill_loop
+
+	li $s4, 0		# pass
+	li $s5, 0		# checksum
+pass_loop:
+	li $t0, 0
+copy_loop:
+	sll $t1, $t0, 2
+	addu $t2, $s0, $t1
+	lw $t3, 0($t2)
+	addu $t3, $t3, $s4
+	addu $t2, $s1, $t1
+	sw $t3, 0($t2)
+	addu $s5, $s5, $t3
+	addiu $t0, $t0, 1
+	blt $t0, $s3, copy_loop
+	addiu $s4, $s4, 1
+	blt $s4, 40, pass_loop
+
+	move $a0, $s5		# print checksum
+	li $v0, 1
+	syscall
+	li $a0, 10
+	li $v0, 11
+	syscall
+	jr $ra
@@ -0,0 +1,442 @@
+/* SPIM S20 MIPS simulator.
+   Microbenchmarks for memory accessors, instruction decoding, and labels.
+
+   Copyright (c) 1990-2015, James R. Larus.
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without modification,
+   are permitted provided that the following conditions are met:
+
+   Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation and/or
+   other materials provided with the distribution.
+
+   Neither the name of the James R. Larus nor the names of its contributors may be
+   used to endorse or promote products derived from this software without specific
+   prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* Standalone harness that times the simulator's hot primitives in
+   isolation: memory reads and writes in each segment, instruction fetch,
+   decoding and encoding, disassembly, and symbol lookup.  Inputs come from
+   a fixed-seed generator, so runs are repeatable.  Results are reported in
+   nanoseconds per operation.
+
+   Usage: microbench [SCALE]
+   SCALE multiplies the number of iterations of every benchmark. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include <time.h>
+
+#include "spim.h"
+#include "string-stream.h"
+#include "spim-utils.h"
+#include "inst.h"
+#include "reg.h"
+#include "mem.h"
+#include "sym-tbl.h"
+
+
+/* Local functions: */
+
+static void bench_format_an_inst (long iterations);
+static void bench_inst_decode (long iterations);
+static void bench_inst_encode (long iterations);
+static void bench_lookup_label (long iterations);
+static void bench_read_mem_inst (const char *name, mem_addr bot, mem_addr top, long iterations);
+static void bench_read_mem_word (const char *name, mem_addr bot, mem_addr top, long iterations);
+static void bench_set_mem_byte (const char *name, mem_addr bot, mem_addr top, long iterations);
+static void fill_addresses (mem_addr bot, mem_addr top, int align);
+static void fill_text (mem_addr bot, mem_addr top);
+static double now_ns ();
+static void report (const char *name, long iterations, double start_ns);
+static uint32 random_word ();
+
+
+/* Exported Variables: */
+
+/* Front-end state the CPU code expects. */
+
+jmp_buf spim_top_level_env;
+
+bool bare_machine;
+bool delayed_branches;
+bool delayed_loads;
+bool accept_pseudo_insts;
+bool quiet;
+bool assemble;
+char *exception_file_name = NULL;
+port message_out, console_out, console_in;
+bool mapped_io;
+int pipe_out;
+int spim_return_value;
+
+
+/* Local variables: */
+
+/* Size of the tables of precomputed inputs (a power of 2). */
+#define POOL_SIZE 4096
+#define POOL_MASK (POOL_SIZE - 1)
+
+/* Number of labels in the symbol table for the lookup benchmark. */
+#define LABEL_COUNT 2000
+
+/* Fixed seed, so every run sees the same inputs. */
+static uint32 random_state = 0x2545f491;
+
+static mem_addr addresses[POOL_SIZE];
+
+static int32 encodings[POOL_SIZE];
+
+static instruction *decoded[POOL_SIZE];
+
+static char *label_names[POOL_SIZE];
+
+/* Results are accumulated here so the compiler cannot discard the work. */
+static volatile uint32 sink;
+
+
+
+int
+main (int argc, char **argv)
+{
+  long scale = (argc > 1 ? atol (argv[1]) : 1);
+  long n = 2000000 * (scale > 0 ? scale : 1);
+
+  console_out.f = stdout;
+  message_out.f = stdout;
+  accept_pseudo_insts = true;
+  quiet = true;
+
+  initialize_world (NULL, false);
+  fill_text (TEXT_BOT, text_top);
+  fill_text (K_TEXT_BOT, k_text_top);
+
+  printf ("%-32s %12s %10s\n", "benchmark", "iterations", "ns/op");
+
+  bench_read_mem_word ("read_mem_word (data)", DATA_BOT, data_top, n);
+  bench_read_mem_word ("read_mem_word (stack)", stack_bot, STACK_TOP, n);
+  bench_read_mem_word ("read_mem_word (kernel data)", K_DATA_BOT, k_data_top, n);
+
+  bench_set_mem_byte ("set_mem_byte (data)", DATA_BOT, data_top, n);
+  bench_set_mem_byte ("set_mem_byte (stack)", stack_bot, STACK_TOP, n);
+  bench_set_mem_byte ("set_mem_byte (kernel data)", K_DATA_BOT, k_data_top, n);
+
+  bench_read_mem_inst ("read_mem_inst (text)", TEXT_BOT, text_top, n);
+  bench_read_mem_inst ("read_mem_inst (kernel text)", K_TEXT_BOT, k_text_top, n);
+
+  bench_inst_decode (n / 4);
+  bench_inst_encode (n);
+  bench_format_an_inst (n / 20);
+  bench_lookup_label (n);
+
+  return (0);
+}
+
+
+static void
+bench_read_mem_word (const char *name, mem_addr bot, mem_addr top, long iterations)
+{
+  uint32 sum = 0;
+  double start;
+  long i;
+
+  fill_addresses (bot, top, BYTES_PER_WORD);
+  start = now_ns ();
+  for (i = 0; i < iterations; i++)
+    sum += read_mem_word (addresses[i & POOL_MASK]);
+  report (name, iterations, start);
+  sink += sum;
+}
+
+
+static void
+bench_set_mem_byte (const char *name, mem_addr bot, mem_addr top, long iterations)
+{
+  double start;
+  long i;
+
+  fill_addresses (bot, top, 1);
+  start = now_ns ();
+  for (i = 0; i < iterations; i++)
+    set_mem_byte (addresses[i & POOL_MASK], (reg_word) i);
+  report (name, iterations, start);
+}
+
+
+static void
+bench_read_mem_inst (const char *name, mem_addr bot, mem_addr top, long iterations)
+{
+  uint32 sum = 0;
+  double start;
+  long i;
+
+  fill_addresses (bot, top, BYTES_PER_WORD);
+  start = now_ns ();
+  for (i = 0; i < iterations; i++)
+    sum += OPCODE (read_mem_inst (addresses[i & POOL_MASK]));
+  report (name, iterations, start);
+  sink += sum;
+}
+
+
+/* Decoding allocates an instruction, so the time includes freeing it. */
+
+static void
+bench_inst_decode (long iterations)
+{
+  uint32 sum = 0;
+  double start;
+  long i;
+
+  start = now_ns ();
+  for (i = 0; i < iterations; i++)
+    {
+      instruction *inst = inst_decode (encodings[i & POOL_MASK]);
+
+      sum += OPCODE (inst);
+      free_inst (inst);
+    }
+  report ("inst_decode (+ free_inst)", iterations, start);
+  sink += sum;
+}
+
+
+static void
+bench_inst_encode (long iterations)
+{
+  uint32 sum = 0;
+  double start;
+  long i;
+
+  start = now_ns ();
+  for (i = 0; i < iterations; i++)
+    sum += inst_encode (decoded[i & POOL_MASK]);
+  report ("inst_encode", iterations, start);
+  sink += sum;
+}
+
+
+static void
+bench_format_an_inst (long iterations)
+{
+  str_stream ss;
+  uint32 sum = 0;
+  double start;
+  long i;
+
+  ss_init (&ss);
+  start = now_ns ();
+  for (i = 0; i < iterations; i++)
+    {
+      ss_clear (&ss);
+      format_an_inst (&ss, decoded[i & POOL_MASK], TEXT_BOT + (i & POOL_MASK) * BYTES_PER_WORD);
+      sum += ss_length (&ss);
+    }
+  report ("format_an_inst", iterations, start);
+  sink += sum;
+}
+
+
+/* Look up labels that are in the table.  (Looking up a missing label
+   creates it, which would change the table as the benchmark runs.) */
+
+static void
+bench_lookup_label (long iterations)
+{
+  char *names[LABEL_COUNT];
+  uint32 sum = 0;
+  double start;
+  long i;
+
+  for (i = 0; i < LABEL_COUNT; i++)
+    {
+      char name[32];
+
+      sprintf (name, "label_%ld_%04x", i, random_word () & 0xffff);
+      names[i] = str_copy (name);
+      record_label (names[i], DATA_BOT + i * BYTES_PER_WORD);
+    }
+  for (i = 0; i < POOL_SIZE; i++)
+    label_names[i] = names[random_word () % LABEL_COUNT];
+
+  start = now_ns ();
+  for (i = 0; i < iterations; i++)
+    sum += lookup_label (label_names[i & POOL_MASK])->addr;
+  report ("lookup_label", iterations, start);
+  sink += sum;
+}
+
+
+/* Fill ADDRESSES with random addresses in [BOT, TOP) aligned to ALIGN. */
+
+static void
+fill_addresses (mem_addr bot, mem_addr top, int align)
+{
+  uint32 slots = (top - bot) / align;
+  int i;
+
+  for (i = 0; i < POOL_SIZE; i++)
+    addresses[i] = bot + (random_word () % slots) * align;
+}
+
+
+/* Fill the text segment [BOT, TOP) with decoded random instructions and
+   build the pools of valid encodings and decoded instructions. */
+
+static void
+fill_text (mem_addr bot, mem_addr top)
+{
+  static int pool_filled = 0;
+  mem_addr addr;
+
+  while (pool_filled < POOL_SIZE)
+    {
+      int32 value = (int32) random_word ();
+      instruction *inst = inst_decode (value);
+
+      if (OPCODE (inst) == 0)
+	{
+	  /* Not a valid instruction */
+	  free_inst (inst);
+	  continue;
+	}
+      encodings[pool_filled] = value;
+      decoded[pool_filled] = inst;
+      pool_filled += 1;
+    }
+
+  for (addr = bot; addr < top; addr += BYTES_PER_WORD)
+    set_mem_inst (addr, decoded[((addr - bot) / BYTES_PER_WORD) & POOL_MASK]);
+}
+
+
+static double
+now_ns ()
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+
+static void
+report (const char *name, long iterations, double start_ns)
+{
+  double elapsed = now_ns () - start_ns;
+
+  printf ("%-32s %12ld %10.2f\n", name, iterations, elapsed / iterations);
+  fflush (stdout);
+}
+
+
+/* Xorshift generator with a fixed seed. */
+
+static uint32
+random_word ()
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (random_state);
+}
+
+
+
+/* Front-end functions the CPU code expects.  The benchmarks never run a
+   program, so these only report errors. */
+
+void
+error (char *fmt, ...)
+{
+  va_list args;
+
+  va_start (args, fmt);
+  vfprintf (stderr, fmt, args);
+  va_end (args);
+}
+
+
+void
+fatal_error (char *fmt, ...)
+{
+  va_list args;
+
+  va_start (args, fmt);
+  vfprintf (stderr, fmt, args);
+  va_end (args);
+  exit (-1);
+}
+
+
+void
+run_error (char *fmt, ...)
+{
+  va_list args;
+
+  va_start (args, fmt);
+  vfprintf (stderr, fmt, args);
+  va_end (args);
+  exit (-1);
+}
+
+
+void
+write_output (port fp, char *fmt, ...)
+{
+  va_list args;
+
+  va_start (args, fmt);
+  vfprintf (fp.f, fmt, args);
+  va_end (args);
+}
+
+
+void
+read_input (char *str, int str_size)
+{
+  if (str_size > 0)
+    str[0] = '\0';
+}
+
+
+int
+console_input_available ()
+{
+  return (0);
+}
+
+
+char
+get_console_char ()
+{
+  return ('\0');
+}
+
+
+void
+put_console_char (char c)
+{
+  putchar (c);
+}
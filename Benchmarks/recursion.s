@@ -0,0 +1,51 @@
+# SPIM benchmark: recursion.
+#
+# Naive recursive Fibonacci.  Measures calls, returns, and stack
+# loads and stores.
+
+	.text
+	.globl main
+main:
+	addiu $sp, $sp, -4
+	sw $ra, 0($sp)
+
+	li $a0, 24
+	jal fib
+
+	move $a0, $v0		# print fib(24)
+	li $v0, 1
+	syscall
+	li $a0, 10
+	li $v0, 11
+	syscall
+
+	lw $ra, 0($sp)
+	addiu $sp, $sp, 4
+	jr $ra
+
+# int fib (int n)
+fib:
+	slti $t0, $a0, 2
+	beq $t0, $zero, fib_recurse
+	move $v0, $a0
+	jr $ra
+
+fib_recurse:
+	addiu $sp, $sp, -12
+	sw $ra, 0($sp)
+	sw $a0, 4($sp)
+
+	addiu $a0, $a0, -1
+	jal fib
+	sw $v0, 8($sp)
+
+	lw $a0, 4($sp)
+	addiu $a0, $a0, -2
+	jal fib
+
+	lw $t0, 8($sp)
+	addu $v0, $v0, $t0
+
+	lw $ra, 0($sp)
+	addiu $sp, $sp, 12
+	jr $ra
@@ -0,0 +1,54 @@
+#!/bin/bash
+#
+# SPIM S20 MIPS Simulator.
+# Run the benchmark suite and report simulator speed.
+#
+# Usage: run-bench.sh SPIM EXCEPTION_FILE RUNS PROGRAM.s ...
+#
+# Each program is run RUNS times, headless, with console output discarded.
+# The fastest run is reported: simulated instructions, millions of simulated
+# instructions per second, startup time (initialize, assemble, and load),
+# run time, and peak resident memory.
+#
+
+if [ $# -lt 4 ]; then
+    echo "Usage: $0 SPIM EXCEPTION_FILE RUNS PROGRAM.s ..." >&2
+    exit 2
+fi
+
+spim=$1
+exception_file=$2
+runs=$3
+shift 3
+
+status=0
+printf "%-16s %12s %10s %12s %10s %12s\n" \
+       "benchmark" "instructions" "MIPS" "startup(ms)" "run(ms)" "peak RSS(KB)"
+
+for program in "$@"; do
+    best=""
+    for ((run = 0; run < runs; run++)); do
+        stats=$("$spim" -stats -exception_file "$exception_file" -file "$program" \
+                    2>&1 >/dev/null </dev/null | grep '^spim-stats:')
+        if [ -z "$stats" ]; then
+            echo "$(basename "$program" .s): no statistics reported" >&2
+            status=1
+            break
+        fi
+        run_ms=$(echo "$stats" | sed 's/.* run_ms=\([0-9.]*\).*/\1/')
+        if [ -z "$best" ] || awk "BEGIN { exit !($run_ms < $best_ms) }"; then
+            best=$stats
+            best_ms=$run_ms
+        fi
+    done
+    [ -z "$best" ] && continue
+
+    echo "$best" | awk -v name="$(basename "$program" .s)" '
+        {
+          for (i = 2; i <= NF; i++) { split ($i, kv, "="); v[kv[1]] = kv[2] }
+          printf "%-16s %12d %10.2f %12.3f %10.3f %12d\n", name,
+                 v["instructions"], v["mips"], v["startup_ms"], v["run_ms"], v["peak_rss_kb"]
+        }'
+done
+
+exit $status
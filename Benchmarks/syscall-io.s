@@ -0,0 +1,32 @@
+# SPIM benchmark: syscall-heavy console output.
+#
+# Prints integers, strings, and characters through syscalls.  Measures
+# the syscall path and console output.
+
+	.data
+label:	.asciiz "line "
+sep:	.asciiz ": value = "
+
+	.text
+	.globl main
+main:
+	li $s0, 0
+loop:
+	la $a0, label
+	li $v0, 4
+	syscall
+	move $a0, $s0
+	li $v0, 1
+	syscall
+	la $a0, sep
+	li $v0, 4
+	syscall
+	mul $a0, $s0, $s0
+	li $v0, 1
+	syscall
+	li $a0, 10
+	li $v0, 11
+	syscall
+	addiu $s0, $s0, 1
+	blt $s0, 20000, loop
+	jr $ra
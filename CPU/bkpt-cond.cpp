@@ -0,0 +1,610 @@
+/* SPIM S20 MIPS simulator.
+   Compiler and interpreter for breakpoint conditions.
+
+   Copyright (c) 1990-2020, James R. Larus.
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without modification,
+   are permitted provided that the following conditions are met:
+
+   Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation and/or
+   other materials provided with the distribution.
+
+   Neither the name of the James R. Larus nor the names of its contributors may be
+   used to endorse or promote products derived from this software without specific
+   prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "spim.h"
+#include "string-stream.h"
+#include "spim-utils.h"
+#include "inst.h"
+#include "reg.h"
+#include "mem.h"
+#include "scanner.h"
+#include "sym-tbl.h"
+#include "bkpt-cond.h"
+
+
+/* Bytecode operations.  BC_CONST and BC_REG are followed by one operand;
+   the jumps are followed by the index of their target. */
+
+enum bc_op
+{
+  BC_CONST, BC_REG, BC_PC, BC_HI, BC_LO,
+  BC_MEM_WORD, BC_MEM_HALF, BC_MEM_BYTE,
+  BC_NEG, BC_NOT, BC_BIT_NOT, BC_BOOL,
+  BC_MUL, BC_DIV, BC_REM, BC_ADD, BC_SUB, BC_SLL, BC_SRA,
+  BC_LT, BC_LE, BC_GT, BC_GE, BC_EQ, BC_NE,
+  BC_AND, BC_XOR, BC_OR,
+  BC_JZ_KEEP, BC_JNZ_KEEP, BC_POP
+};
+
+
+/* Evaluation stack size.  Deeper expressions are rejected when they are
+   compiled. */
+
+#define BKPT_COND_STACK_SIZE 32
+
+
+/* Local functions: */
+
+static void cond_error (const char *msg);
+static void emit (int op);
+static void emit_binary (int op);
+static int match (const char *tok);
+static void parse_additive ();
+static void parse_and ();
+static void parse_bit_and ();
+static void parse_bit_or ();
+static void parse_bit_xor ();
+static void parse_equality ();
+static void parse_multiplicative ();
+static void parse_or ();
+static void parse_primary ();
+static void parse_relational ();
+static void parse_shift ();
+static void parse_unary ();
+static void push_value ();
+static int32 read_cond_mem (mem_addr addr, int size);
+static void skip_blanks ();
+
+
+/* Local variables: */
+
+/* Compiler state.  Only one condition is compiled at a time. */
+
+static char *cond_text;		/* Next character to scan */
+
+static int *cond_code;		/* Code buffer being filled */
+
+static int cond_length;		/* Ints used in COND_CODE */
+
+static int cond_max_length;	/* Size of COND_CODE */
+
+static int cond_depth;		/* Stack depth at this point in code */
+
+static bool cond_failed;	/* Error already reported */
+
+
+
+/* Compile the condition in TEXT.  Return NULL, after reporting an error,
+   if it is not a well-formed expression. */
+
+bkpt_cond *
+compile_bkpt_condition (char *text)
+{
+  bkpt_cond *cond;
+
+  cond_text = text;
+  cond_max_length = 32;
+  cond_code = (int *) xmalloc (cond_max_length * sizeof (int));
+  cond_length = 0;
+  cond_depth = 0;
+  cond_failed = false;
+
+  parse_or ();
+  skip_blanks ();
+  if (!cond_failed && *cond_text != '\0')
+    cond_error ("unexpected text");
+
+  if (cond_failed)
+    {
+      free (cond_code);
+      return NULL;
+    }
+
+  cond = (bkpt_cond *) xmalloc (sizeof (bkpt_cond));
+  cond->code = cond_code;
+  cond->length = cond_length;
+  return cond;
+}
+
+
+void
+free_bkpt_condition (bkpt_cond *cond)
+{
+  if (cond != NULL)
+    {
+      free (cond->code);
+      free (cond);
+    }
+}
+
+
+/* Evaluate COND against the current machine state.  Evaluation never
+   raises a MIPS exception: a read from an unmapped or misaligned address
+   yields 0, as does division by 0. */
+
+int32
+eval_bkpt_condition (bkpt_cond *cond)
+{
+  int32 stack[BKPT_COND_STACK_SIZE];
+  int32 *sp = stack - 1;
+  int *code = cond->code;
+  int pc = 0;
+
+#define BINARY(EXPR) { int32 y = *sp--; int32 x = *sp; *sp = (EXPR); break; }
+
+  while (pc < cond->length)
+    switch (code[pc++])
+      {
+      case BC_CONST: *++sp = code[pc++]; break;
+      case BC_REG: *++sp = R[code[pc++]]; break;
+      case BC_PC: *++sp = PC; break;
+      case BC_HI: *++sp = HI; break;
+      case BC_LO: *++sp = LO; break;
+
+      case BC_MEM_WORD: *sp = read_cond_mem (*sp, BYTES_PER_WORD); break;
+      case BC_MEM_HALF: *sp = read_cond_mem (*sp, 2); break;
+      case BC_MEM_BYTE: *sp = read_cond_mem (*sp, 1); break;
+
+      case BC_NEG: *sp = (int32) (- (uint32) *sp); break;
+      case BC_NOT: *sp = ! *sp; break;
+      case BC_BIT_NOT: *sp = ~ *sp; break;
+      case BC_BOOL: *sp = (*sp != 0); break;
+
+      case BC_MUL: BINARY ((int32) ((uint32) x * (uint32) y))
+      case BC_DIV: BINARY (y == 0 ? 0 : (int32) ((long long) x / y))
+      case BC_REM: BINARY (y == 0 ? 0 : (int32) ((long long) x % y))
+      case BC_ADD: BINARY ((int32) ((uint32) x + (uint32) y))
+      case BC_SUB: BINARY ((int32) ((uint32) x - (uint32) y))
+      case BC_SLL: BINARY ((int32) ((uint32) x << (y & 0x1f)))
+      case BC_SRA: BINARY (x >> (y & 0x1f))
+      case BC_LT: BINARY (x < y)
+      case BC_LE: BINARY (x <= y)
+      case BC_GT: BINARY (x > y)
+      case BC_GE: BINARY (x >= y)
+      case BC_EQ: BINARY (x == y)
+      case BC_NE: BINARY (x != y)
+      case BC_AND: BINARY (x & y)
+      case BC_XOR: BINARY (x ^ y)
+      case BC_OR: BINARY (x | y)
+
+      case BC_JZ_KEEP:
+	pc = (*sp == 0) ? code[pc] : pc + 1;
+	break;
+
+      case BC_JNZ_KEEP:
+	pc = (*sp != 0) ? code[pc] : pc + 1;
+	break;
+
+      case BC_POP: sp -= 1; break;
+      }
+
+#undef BINARY
+
+  return *sp;
+}
+
+
+/* Read SIZE bytes at ADDR from a data segment without side effects. */
+
+static int32
+read_cond_mem (mem_addr addr, int size)
+{
+  if (addr & (size - 1))
+    return 0;
+  if (!(((addr >= DATA_BOT) && (addr < data_top))
+	|| ((addr >= stack_bot) && (addr < STACK_TOP))
+	|| ((addr >= K_DATA_BOT) && (addr < k_data_top))))
+    return 0;
+
+  if (size == BYTES_PER_WORD)
+    return read_mem_word (addr);
+  else if (size == 2)
+    return read_mem_half (addr);
+  else
+    return read_mem_byte (addr);
+}
+
+
+
+/* Recursive-descent compiler, with the precedence of C operators. */
+
+static void
+cond_error (const char *msg)
+{
+  if (!cond_failed)
+    {
+      if (*cond_text == '\0')
+	error ("Bad breakpoint condition: %s at end\n", msg);
+      else
+	error ("Bad breakpoint condition: %s at `%s'\n", msg, cond_text);
+    }
+  cond_failed = true;
+}
+
+
+static void
+emit (int op)
+{
+  if (cond_length == cond_max_length)
+    {
+      cond_max_length *= 2;
+      cond_code = (int *) realloc (cond_code, cond_max_length * sizeof (int));
+      if (cond_code == NULL)
+	fatal_error ("Out of memory\n");
+    }
+  cond_code[cond_length++] = op;
+}
+
+
+/* Emit an operation that pops two values and pushes one. */
+
+static void
+emit_binary (int op)
+{
+  emit (op);
+  cond_depth -= 1;
+}
+
+
+static void
+push_value ()
+{
+  cond_depth += 1;
+  if (cond_depth > BKPT_COND_STACK_SIZE)
+    cond_error ("expression too complex");
+}
+
+
+static void
+skip_blanks ()
+{
+  while (isspace (*cond_text))
+    cond_text += 1;
+}
+
+
+/* If the next token is TOK, consume it and return true.  A single-character
+   operator does not match the prefix of a two-character operator. */
+
+static int
+match (const char *tok)
+{
+  int len = strlen (tok);
+
+  skip_blanks ();
+  if (strncmp (cond_text, tok, len) != 0)
+    return 0;
+  if (len == 1 && cond_text[1] != '\0'
+      && strchr ("&|<>=", tok[0]) != NULL
+      && (cond_text[1] == tok[0] || cond_text[1] == '='))
+    return 0;
+  if (len == 1 && tok[0] == '!' && cond_text[1] == '=')
+    return 0;
+  cond_text += len;
+  return 1;
+}
+
+
+static void
+parse_or ()
+{
+  parse_and ();
+  while (!cond_failed && match ("||"))
+    {
+      int fixup;
+
+      emit (BC_BOOL);
+      emit (BC_JNZ_KEEP);
+      fixup = cond_length;
+      emit (0);
+      emit (BC_POP);
+      cond_depth -= 1;
+      parse_and ();
+      emit (BC_BOOL);
+      cond_code[fixup] = cond_length;
+    }
+}
+
+
+static void
+parse_and ()
+{
+  parse_bit_or ();
+  while (!cond_failed && match ("&&"))
+    {
+      int fixup;
+
+      emit (BC_BOOL);
+      emit (BC_JZ_KEEP);
+      fixup = cond_length;
+      emit (0);
+      emit (BC_POP);
+      cond_depth -= 1;
+      parse_bit_or ();
+      emit (BC_BOOL);
+      cond_code[fixup] = cond_length;
+    }
+}
+
+
+static void
+parse_bit_or ()
+{
+  parse_bit_xor ();
+  while (!cond_failed && match ("|"))
+    {
+      parse_bit_xor ();
+      emit_binary (BC_OR);
+    }
+}
+
+
+static void
+parse_bit_xor ()
+{
+  parse_bit_and ();
+  while (!cond_failed && match ("^"))
+    {
+      parse_bit_and ();
+      emit_binary (BC_XOR);
+    }
+}
+
+
+static void
+parse_bit_and ()
+{
+  parse_equality ();
+  while (!cond_failed && match ("&"))
+    {
+      parse_equality ();
+      emit_binary (BC_AND);
+    }
+}
+
+
+static void
+parse_equality ()
+{
+  parse_relational ();
+  while (!cond_failed)
+    if (match ("=="))
+      parse_relational (), emit_binary (BC_EQ);
+    else if (match ("!="))
+      parse_relational (), emit_binary (BC_NE);
+    else
+      break;
+}
+
+
+static void
+parse_relational ()
+{
+  parse_shift ();
+  while (!cond_failed)
+    if (match ("<="))
+      parse_shift (), emit_binary (BC_LE);
+    else if (match (">="))
+      parse_shift (), emit_binary (BC_GE);
+    else if (match ("<"))
+      parse_shift (), emit_binary (BC_LT);
+    else if (match (">"))
+      parse_shift (), emit_binary (BC_GT);
+    else
+      break;
+}
+
+
+static void
+parse_shift ()
+{
+  parse_additive ();
+  while (!cond_failed)
+    if (match ("<<"))
+      parse_additive (), emit_binary (BC_SLL);
+    else if (match (">>"))
+      parse_additive (), emit_binary (BC_SRA);
+    else
+      break;
+}
+
+
+static void
+parse_additive ()
+{
+  parse_multiplicative ();
+  while (!cond_failed)
+    if (match ("+"))
+      parse_multiplicative (), emit_binary (BC_ADD);
+    else if (match ("-"))
+      parse_multiplicative (), emit_binary (BC_SUB);
+    else
+      break;
+}
+
+
+static void
+parse_multiplicative ()
+{
+  parse_unary ();
+  while (!cond_failed)
+    if (match ("*"))
+      parse_unary (), emit_binary (BC_MUL);
+    else if (match ("/"))
+      parse_unary (), emit_binary (BC_DIV);
+    else if (match ("%"))
+      parse_unary (), emit_binary (BC_REM);
+    else
+      break;
+}
+
+
+static void
+parse_unary ()
+{
+  if (match ("-"))
+    parse_unary (), emit (BC_NEG);
+  else if (match ("!"))
+    parse_unary (), emit (BC_NOT);
+  else if (match ("~"))
+    parse_unary (), emit (BC_BIT_NOT);
+  else
+    parse_primary ();
+}
+
+
+/* Primary expressions are integers, registers ($t0, $pc, $hi, $lo),
+   labels, parenthesized expressions, and memory references of the form
+   mem[EXPR], half[EXPR], or byte[EXPR]. */
+
+static void
+parse_primary ()
+{
+  char name[256];
+  int len;
+  bool is_register = false;
+
+  skip_blanks ();
+  if (cond_failed)
+    return;
+
+  if (match ("("))
+    {
+      parse_or ();
+      if (!cond_failed && !match (")"))
+	cond_error ("missing `)'");
+      return;
+    }
+
+  if (isdigit (*cond_text))
+    {
+      char *end;
+      int32 value = (int32) strtoul (cond_text, &end, 0);
+
+      cond_text = end;
+      emit (BC_CONST);
+      emit (value);
+      push_value ();
+      return;
+    }
+
+  if (*cond_text == '$')
+    {
+      cond_text += 1;
+      is_register = true;
+    }
+  else if (!(isalpha (*cond_text) || *cond_text == '_' || *cond_text == '.'))
+    {
+      cond_error ("expected a value");
+      return;
+    }
+
+  for (len = 0; isalnum (cond_text[len]) || cond_text[len] == '_'
+	 || cond_text[len] == '.' || cond_text[len] == '$'; len += 1)
+    ;
+  if (len == 0 || len >= (int) sizeof (name))
+    {
+      cond_error ("expected a register name");
+      return;
+    }
+  strncpy (name, cond_text, len);
+  name[len] = '\0';
+
+  if (is_register)
+    {
+      int reg_no = -1;
+
+      if (streq (name, "pc"))
+	emit (BC_PC);
+      else if (streq (name, "hi"))
+	emit (BC_HI);
+      else if (streq (name, "lo"))
+	emit (BC_LO);
+      else if ((name[0] == 'f' && isdigit (name[1]))
+	       || (reg_no = register_name_to_number (name)) < 0
+	       || reg_no >= R_LENGTH)
+	{
+	  cond_error ("unknown register");
+	  return;
+	}
+      else
+	{
+	  emit (BC_REG);
+	  emit (reg_no);
+	}
+      cond_text += len;
+      push_value ();
+      return;
+    }
+
+  cond_text += len;
+  if (match ("["))
+    {
+      int op;
+
+      if (streq (name, "mem"))
+	op = BC_MEM_WORD;
+      else if (streq (name, "half"))
+	op = BC_MEM_HALF;
+      else if (streq (name, "byte"))
+	op = BC_MEM_BYTE;
+      else
+	{
+	  cond_error ("expected mem, half, or byte before `['");
+	  return;
+	}
+      parse_or ();
+      if (!cond_failed && !match ("]"))
+	cond_error ("missing `]'");
+      emit (op);
+    }
+  else
+    {
+      label *l = label_is_defined (name);
+
+      if (l == NULL || l->addr == 0)
+	{
+	  cond_text -= len;
+	  cond_error ("undefined symbol");
+	  return;
+	}
+      emit (BC_CONST);
+      emit (l->addr);
+      push_value ();
+    }
+}
@@ -0,0 +1,51 @@
+/* SPIM S20 MIPS simulator.
+   Compiled breakpoint conditions.
+
+   Copyright (c) 1990-2015, James R. Larus.
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without modification,
+   are permitted provided that the following conditions are met:
+
+   Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation and/or
+   other materials provided with the distribution.
+
+   Neither the name of the James R. Larus nor the names of its contributors may be
+   used to endorse or promote products derived from this software without specific
+   prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* A breakpoint condition is an expression over registers and memory,
+   such as "$t0 == 5 && mem[$sp+4] > 0".  It is compiled once, when the
+   breakpoint is set, into a small stack bytecode that is evaluated each
+   time the breakpoint's address is reached. */
+
+typedef struct bkpt_cond_rec
+{
+  int *code;			/* Bytecode: opcode followed by operands */
+  int length;			/* Number of ints in CODE */
+} bkpt_cond;
+
+
+
+/* Exported functions: */
+
+bkpt_cond *compile_bkpt_condition (char *text);
+int32 eval_bkpt_condition (bkpt_cond *cond);
+void free_bkpt_condition (bkpt_cond *cond);
@@ -167,6 +167,26 @@ current_data_pc ()
 }
 
 
+/* Return the address at which the next item accessed off $gp will be
+   allocated. */
+
+mem_addr
+current_gp_item_addr ()
+{
+  return (next_gp_item_addr);
+}
+
+
+/* Set the address at which the next item accessed off $gp will be
+   allocated. */
+
+void
+set_gp_item_addr (mem_addr addr)
+{
+  next_gp_item_addr = addr;
+}
+
+
 /* Bump the address at which the next data will be stored by DELTA
    bytes. */
 
@@ -201,7 +221,7 @@ extern_directive (char *name, int size)
       && next_gp_item_addr + size < gp_midpoint + 32*K)
     {
       sym->gp_flag = 1;
-      sym->addr = next_gp_item_addr;
+      set_label_address (sym, next_gp_item_addr);
       next_gp_item_addr += size;
     }
 }
@@ -216,7 +236,7 @@ lcomm_directive (char *name, int size)
       && size > 0 && size <= SMALL_DATA_SEG_MAX_SIZE
       && next_gp_item_addr + size < gp_midpoint + 32*K)
     {
-      label *sym = record_label (name, next_gp_item_addr, 1);
+      label *sym = record_label (name, next_gp_item_addr);
       sym->gp_flag = 1;
 
       next_gp_item_addr += size;
@@ -224,7 +244,7 @@ lcomm_directive (char *name, int size)
     }
   else
     {
-      (void)record_label (name, next_data_pc, 1);
+      (void)record_label (name, next_data_pc);
 
       for ( ; size > 0; size --)
 	{
@@ -35,6 +35,7 @@
 
 void align_data (int alignment);
 mem_addr current_data_pc ();
+mem_addr current_gp_item_addr ();
 void data_begins_at_point (mem_addr addr);
 void enable_data_alignment ();
 void end_of_assembly_file ();
@@ -44,6 +45,7 @@ void k_data_begins_at_point (mem_addr addr);
 void lcomm_directive (char *name, int size);
 void set_data_alignment (int);
 void set_data_pc (mem_addr addr);
+void set_gp_item_addr (mem_addr addr);
 void set_text_pc (mem_addr addr);
 void store_byte (int value);
 void store_double (double *value);
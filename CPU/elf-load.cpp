@@ -0,0 +1,405 @@
+/* SPIM S20 MIPS simulator.
+   Loader for MIPS32 ELF executables.
+
+   Copyright (c) 1990-2020, James R. Larus.
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without modification,
+   are permitted provided that the following conditions are met:
+
+   Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation and/or
+   other materials provided with the distribution.
+
+   Neither the name of the James R. Larus nor the names of its contributors may be
+   used to endorse or promote products derived from this software without specific
+   prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spim.h"
+#include "string-stream.h"
+#include "spim-utils.h"
+#include "inst.h"
+#include "reg.h"
+#include "mem.h"
+#include "sym-tbl.h"
+#include "elf-load.h"
+
+
+/* A statically-linked executable produced by a MIPS cross-compiler is
+   loaded without the assembler: each PT_LOAD segment is copied into the
+   text or data segment that contains it, with text words decoded into
+   instructions.  Symbols from the symbol table become labels and the
+   program starts at the ELF entry point.  The executable must have the
+   same byte order as the simulated machine. */
+
+/* Fields of the ELF32 headers that are used here (offsets in bytes): */
+
+#define EI_CLASS	4
+#define EI_DATA		5
+#define ELFCLASS32	1
+#define ELFDATA2LSB	1
+#define ELFDATA2MSB	2
+
+#define E_TYPE		16
+#define E_MACHINE	18
+#define E_ENTRY		24
+#define E_PHOFF		28
+#define E_SHOFF		32
+#define E_PHENTSIZE	42
+#define E_PHNUM		44
+#define E_SHENTSIZE	46
+#define E_SHNUM		48
+#define ELF_HEADER_SIZE	52
+
+#define ET_EXEC		2
+#define EM_MIPS		8
+
+#define P_TYPE		0
+#define P_OFFSET	4
+#define P_VADDR		8
+#define P_FILESZ	16
+#define P_MEMSZ		20
+#define P_FLAGS		24
+#define PHDR_SIZE	32
+
+#define PT_LOAD		1
+#define PF_X		1
+
+#define SH_TYPE		4
+#define SH_OFFSET	16
+#define SH_SIZE		20
+#define SH_LINK		24
+#define SHDR_SIZE	40
+
+#define SHT_SYMTAB	2
+
+#define ST_NAME		0
+#define ST_VALUE	4
+#define ST_INFO		12
+#define ST_SHNDX	14
+#define SYM_SIZE	16
+
+#define STB_LOCAL	0
+#define STT_NOTYPE	0
+#define STT_OBJECT	1
+#define STT_FUNC	2
+#define SHN_UNDEF	0
+#define SHN_LORESERVE	0xff00
+
+
+/* Local functions: */
+
+static uint32 elf_half (unsigned char *p);
+static uint32 elf_word (unsigned char *p);
+static bool load_segment (unsigned char *image, uint32 size, unsigned char *phdr);
+static void load_symbols (unsigned char *image, uint32 size);
+
+
+/* Local variables: */
+
+/* True if the file being loaded is big-endian. */
+
+static bool elf_big_endian;
+
+
+
+/* Return true if file NAME starts with the ELF magic number. */
+
+bool
+is_elf_file (char *name)
+{
+  FILE *file = fopen (name, "rb");
+  unsigned char magic[4];
+  bool is_elf;
+
+  if (file == NULL)
+    return (false);
+  is_elf = (fread (magic, 1, 4, file) == 4
+	    && magic[0] == 0x7f && magic[1] == 'E'
+	    && magic[2] == 'L' && magic[3] == 'F');
+  fclose (file);
+  return (is_elf);
+}
+
+
+/* Load the MIPS32 ELF executable in file NAME.  Return true if
+   successful and false otherwise. */
+
+bool
+read_elf_file (char *name)
+{
+  FILE *file = fopen (name, "rb");
+  unsigned char *image;
+  long size;
+  uint32 phoff, phentsize, phnum;
+  uint32 i;
+  bool ok = true;
+
+  if (file == NULL)
+    {
+      error ("Cannot open file: `%s'\n", name);
+      return false;
+    }
+  fseek (file, 0, SEEK_END);
+  size = ftell (file);
+  rewind (file);
+  image = (unsigned char *) xmalloc (size < ELF_HEADER_SIZE ? ELF_HEADER_SIZE : (int) size);
+  if (size < ELF_HEADER_SIZE || fread (image, 1, size, file) != (size_t) size)
+    {
+      fclose (file);
+      free (image);
+      error ("Cannot read ELF header of `%s'\n", name);
+      return false;
+    }
+  fclose (file);
+
+  elf_big_endian = (image[EI_DATA] == ELFDATA2MSB);
+  if (image[EI_CLASS] != ELFCLASS32
+      || (image[EI_DATA] != ELFDATA2LSB && image[EI_DATA] != ELFDATA2MSB)
+      || elf_half (image + E_MACHINE) != EM_MIPS
+      || elf_half (image + E_TYPE) != ET_EXEC)
+    {
+      error ("`%s' is not a MIPS32 executable\n", name);
+      free (image);
+      return false;
+    }
+#ifdef SPIM_BIGENDIAN
+  if (!elf_big_endian)
+#else
+  if (elf_big_endian)
+#endif
+    {
+      error ("`%s' does not have the same byte order as SPIM\n", name);
+      free (image);
+      return false;
+    }
+
+  phoff = elf_word (image + E_PHOFF);
+  phentsize = elf_half (image + E_PHENTSIZE);
+  phnum = elf_half (image + E_PHNUM);
+  if (phentsize < PHDR_SIZE
+      || phoff > (uint32) size
+      || phnum > ((uint32) size - phoff) / phentsize)
+    {
+      error ("Bad program header table in `%s'\n", name);
+      free (image);
+      return false;
+    }
+
+  for (i = 0; ok && i < phnum; i++)
+    {
+      unsigned char *phdr = image + phoff + i * phentsize;
+
+      if (elf_word (phdr + P_TYPE) == PT_LOAD)
+	ok = load_segment (image, (uint32) size, phdr);
+    }
+
+  if (ok)
+    {
+      load_symbols (image, (uint32) size);
+      set_starting_address (elf_word (image + E_ENTRY));
+    }
+  else
+    error ("Cannot load `%s'\n", name);
+
+  free (image);
+  return (ok);
+}
+
+
+/* Copy the segment described by program header PHDR from the executable
+   IMAGE of SIZE bytes into memory.  Return false if it does not fit in
+   one of SPIM's segments. */
+
+static bool
+load_segment (unsigned char *image, uint32 size, unsigned char *phdr)
+{
+  uint32 offset = elf_word (phdr + P_OFFSET);
+  mem_addr vaddr = elf_word (phdr + P_VADDR);
+  uint32 filesz = elf_word (phdr + P_FILESZ);
+  uint32 memsz = elf_word (phdr + P_MEMSZ);
+  mem_addr end = vaddr + memsz;
+  mem_addr addr;
+
+  if (memsz == 0)
+    return (true);
+  if (filesz > memsz || offset > size || filesz > size - offset || end < vaddr)
+    {
+      error ("Segment at 0x%08x extends past end of file\n", vaddr);
+      return (false);
+    }
+
+  /* The user text segment grows to hold large executables. */
+  if (TEXT_BOT <= vaddr && text_top < end && end <= DATA_BOT)
+    expand_text (end - text_top);
+
+  if ((TEXT_BOT <= vaddr && end <= text_top)
+      || (K_TEXT_BOT <= vaddr && end <= k_text_top))
+    {
+      /* Text: decode every word, including rodata that the linker placed
+	 in the same segment, so loads from it see the same encoding. */
+      if ((vaddr & 0x3) != 0)
+	{
+	  error ("Text segment at 0x%08x is not word aligned\n", vaddr);
+	  return (false);
+	}
+      for (addr = vaddr; addr < end; addr += BYTES_PER_WORD)
+	{
+	  uint32 i = addr - vaddr;
+	  unsigned char word[BYTES_PER_WORD];
+	  int j;
+
+	  for (j = 0; j < BYTES_PER_WORD; j++)
+	    word[j] = (i + j < filesz) ? image[offset + i + j] : 0;
+	  set_mem_inst (addr, inst_decode (elf_word (word)));
+	}
+      return (true);
+    }
+
+  if (DATA_BOT <= vaddr && vaddr < stack_bot)
+    {
+      if (data_top < end)
+	expand_data (end - data_top);
+    }
+  else if (K_DATA_BOT <= vaddr)
+    {
+      if (k_data_top < end)
+	expand_k_data (end - k_data_top);
+    }
+  else
+    {
+      error ("Segment at 0x%08x does not fit in SPIM's memory\n", vaddr);
+      return (false);
+    }
+
+  for (addr = vaddr; addr < end; addr++)
+    {
+      uint32 i = addr - vaddr;
+
+      set_mem_byte (addr, (i < filesz) ? image[offset + i] : 0);
+    }
+  return (true);
+}
+
+
+/* Enter the function and object symbols from the executable IMAGE of
+   SIZE bytes in the symbol table.  The executable's definitions replace
+   the exception handler's, whose startup code it supersedes. */
+
+static void
+load_symbols (unsigned char *image, uint32 size)
+{
+  uint32 shoff = elf_word (image + E_SHOFF);
+  uint32 shentsize = elf_half (image + E_SHENTSIZE);
+  uint32 shnum = elf_half (image + E_SHNUM);
+  uint32 i;
+
+  if (shoff == 0
+      || shentsize < SHDR_SIZE
+      || shoff > size
+      || shnum > (size - shoff) / shentsize)
+    return;
+
+  for (i = 0; i < shnum; i++)
+    {
+      unsigned char *shdr = image + shoff + i * shentsize;
+      unsigned char *strtab_hdr;
+      uint32 sym_off, sym_size, str_off, str_size;
+      uint32 link;
+      uint32 j;
+
+      if (elf_word (shdr + SH_TYPE) != SHT_SYMTAB)
+	continue;
+
+      link = elf_word (shdr + SH_LINK);
+      if (link >= shnum)
+	continue;
+      strtab_hdr = image + shoff + link * shentsize;
+      sym_off = elf_word (shdr + SH_OFFSET);
+      sym_size = elf_word (shdr + SH_SIZE);
+      str_off = elf_word (strtab_hdr + SH_OFFSET);
+      str_size = elf_word (strtab_hdr + SH_SIZE);
+      if (sym_off > size || sym_size > size - sym_off
+	  || str_off > size || str_size > size - str_off
+	  || str_size == 0 || image[str_off + str_size - 1] != '\0')
+	continue;
+
+      for (j = 0; j + SYM_SIZE <= sym_size; j += SYM_SIZE)
+	{
+	  unsigned char *sym = image + sym_off + j;
+	  uint32 name = elf_word (sym + ST_NAME);
+	  mem_addr value = elf_word (sym + ST_VALUE);
+	  int bind = sym[ST_INFO] >> 4;
+	  int type = sym[ST_INFO] & 0xf;
+	  uint32 shndx = elf_half (sym + ST_SHNDX);
+	  label *l;
+
+	  if (name == 0 || name >= str_size || value == 0
+	      || shndx == SHN_UNDEF || shndx >= SHN_LORESERVE
+	      || (type != STT_NOTYPE && type != STT_OBJECT && type != STT_FUNC))
+	    continue;
+
+	  if (bind == STB_LOCAL)
+	    {
+	      /* Local names may repeat across object files: keep the
+		 first and never replace a global. */
+	      l = label_is_defined ((char *) image + str_off + name);
+	      if (l != NULL && SYMBOL_IS_DEFINED (l))
+		continue;
+	      l = lookup_label ((char *) image + str_off + name);
+	    }
+	  else
+	    {
+	      l = make_label_global ((char *) image + str_off + name);
+	    }
+
+	  /* The executable is already linked, so drop references left by
+	     the exception handler's startup code. */
+	  drop_label_uses (l);
+	  set_label_address (l, value);
+
+	  if (streq (l->name, "_gp"))
+	    R[REG_GP] = value;
+	}
+    }
+}
+
+
+static uint32
+elf_half (unsigned char *p)
+{
+  if (elf_big_endian)
+    return ((p[0] << 8) | p[1]);
+  else
+    return ((p[1] << 8) | p[0]);
+}
+
+
+static uint32
+elf_word (unsigned char *p)
+{
+  if (elf_big_endian)
+    return (((uint32) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+  else
+    return (((uint32) p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0]);
+}
@@ -0,0 +1,1389 @@
+/* SPIM S20 MIPS simulator.
+   Binary images of assembled code.
+
+   Copyright (c) 1990-2020, James R. Larus.
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without modification,
+   are permitted provided that the following conditions are met:
+
+   Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation and/or
+   other materials provided with the distribution.
+
+   Neither the name of the James R. Larus nor the names of its contributors may be
+   used to endorse or promote products derived from this software without specific
+   prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/mman.h>
+#endif
+
+#include "spim.h"
+#include "string-stream.h"
+#include "spim-utils.h"
+#include "inst.h"
+#include "reg.h"
+#include "mem.h"
+#include "data.h"
+#include "sym-tbl.h"
+#include "image.h"
+
+
+/* SPIM saves assembled code as binary images, which it can later map
+   and install directly instead of running the assembler.
+
+   Assembling the exception handler is the bulk of SPIM's startup time,
+   so the kernel text, data, and symbols that it produces are saved in a
+   handler image in a cache directory.  Later runs install the image, as
+   long as the hash of the handler source still matches.
+
+   A program image (written by -assemble) holds a user program: the user
+   text after the exception handler, the user data segment, and the
+   program's symbols.  Reading it links it against the handler that is
+   already loaded, which must be the handler it was assembled with: the
+   image records the hash of that handler's source.
+
+   An assembly image caches the result of assembling one source file.
+   It is named after a hash of the file's contents, the settings that
+   change how it assembles, and the state it was assembled in (the
+   text and data PCs and the global symbols), so a later run that reads
+   the same file at the same point installs the image instead of
+   scanning and parsing the file again.  The cache keeps at most
+   MAX_CACHED_ASSEMBLIES assembly images and MAX_CACHED_BYTES bytes of
+   them; the least recently used images are removed first.
+
+   An image is a header followed by vectors of instructions, data spans,
+   labels, and label uses, then the data bytes and a string table.  All
+   fields are 32-bit words in host byte order.  Labels that were local
+   to a file (and so flushed from the symbol table) are recreated
+   outside the table, since instructions still refer to them. */
+
+#define IMAGE_MAGIC	0x474d4953 /* "SIMG" */
+#define IMAGE_VERSION	4
+
+#define NO_INDEX	0xffffffff
+
+#define MAX_CACHED_ASSEMBLIES	256
+#define MAX_CACHED_BYTES	(64 * 1024 * 1024)
+
+/* Flags in image_header: */
+#define IMAGE_IN_KTEXT	0x1	/* Next instruction goes to kernel text */
+#define IMAGE_PROGRAM	0x2	/* Program, not handler, image */
+#define IMAGE_ASSEMBLY	0x4	/* Cached assembly of one file */
+
+/* Flags in image_inst: */
+#define INST_HAS_EXPR	0x1
+#define INST_PC_RELATIVE 0x2
+
+/* Flags in image_label: */
+#define LABEL_GLOBAL	0x1
+#define LABEL_GP	0x2
+#define LABEL_CONST	0x4
+#define LABEL_IN_TABLE	0x8
+
+typedef struct
+{
+  uint32 magic;
+  uint32 version;
+  uint32 hash_lo;		/* Hash of source (of the handler, for a program) */
+  uint32 hash_hi;
+  uint32 flags;
+  uint32 text_from;		/* First user text address in image */
+  uint32 k_text_from;		/* First kernel text address in image */
+  uint32 text_pc;		/* Next instruction, user text */
+  uint32 k_text_pc;		/* Next instruction, kernel text */
+  uint32 data_pc;		/* Next datum, user data */
+  uint32 k_data_pc;		/* Next datum, kernel data */
+  uint32 gp_pc;			/* Next item accessed off $gp */
+  uint32 n_insts;
+  uint32 n_spans;
+  uint32 n_labels;
+  uint32 n_uses;
+  uint32 data_size;
+  uint32 strings_size;
+} image_header;
+
+typedef struct
+{
+  uint32 addr;
+  int32 encoding;
+  uint32 source;		/* String offset or NO_INDEX */
+  uint32 flags;
+  uint32 symbol;		/* Label index or NO_INDEX */
+  int32 offset;
+  int32 bits;
+} image_inst;
+
+typedef struct
+{
+  uint32 addr;
+  uint32 length;
+  uint32 offset;		/* Offset of bytes in data area */
+} image_span;
+
+typedef struct
+{
+  uint32 name;			/* String offset */
+  uint32 addr;
+  uint32 flags;
+} image_label;
+
+typedef struct
+{
+  uint32 label;			/* Label index */
+  uint32 addr;
+  uint32 is_inst;		/* 0 => data word at ADDR */
+} image_use;
+
+
+/* Sections of a mapped image. */
+
+typedef struct
+{
+  image_header *hdr;
+  image_inst *insts;
+  image_span *spans;
+  image_label *labels;
+  image_use *uses;
+  BYTE_TYPE *data;
+  char *strings;
+} image_view;
+
+
+/* A mapped image file. */
+
+/* An assembly image in the cache directory: */
+
+typedef struct
+{
+  char *name;
+  time_t used;			/* Last installed or written */
+  off_t size;
+} cached_image;
+
+typedef struct image_map_rec
+{
+  void *addr;
+  size_t size;
+  struct image_map_rec *next;
+} image_map;
+
+
+/* Local functions: */
+
+static void add_data_span (mem_addr from, mem_addr to);
+static bool add_insts (mem_addr from, mem_addr to);
+static uint32 add_label (label *l);
+static uint32 add_source (instruction *inst);
+static uint32 add_string (char *str);
+static unsigned long long assembly_hash (char *name, image_header *start);
+static char *cache_directory ();
+static int compare_cached_images (const void *p1, const void *p2);
+static bool collect_image (mem_addr text_from, mem_addr text_pc,
+			   mem_addr k_text_from, mem_addr k_text_pc,
+			   mem_addr data_from, mem_addr data_pc,
+			   mem_addr k_data_from, mem_addr k_data_pc,
+			   bool allow_gp);
+static void *grow_vector (void *vec, int n, int *size, int elem_size);
+static unsigned long long hash_bytes (unsigned long long hash, const void *bytes, size_t n);
+static bool hash_file (char *name, unsigned long long *hash);
+static char *image_file_name (char *file_names);
+static bool image_is_well_formed (void *addr, size_t size, image_view *v);
+static bool in_text_segment (mem_addr addr);
+static void install_image (image_view *v);
+static bool map_image (char *name, image_view *v);
+static void prune_cache (char *dir);
+static void restore_pcs (image_header *hdr);
+static void save_pcs (image_header *hdr);
+static void set_image_source (instruction *inst, char *str);
+static unsigned long long source_hash (char *file_names);
+static void unmap_last_image ();
+static bool write_image_file (char *name, image_header *hdr);
+
+
+/* Local variables: */
+
+/* Images that have been installed.  Source lines of their instructions
+   point into the mappings, so they stay mapped until the next
+   reinitialization. */
+
+static image_map *image_maps = NULL;
+
+
+/* Hash of the source of the exception handler that is loaded, or 0 if
+   there is none. */
+
+static unsigned long long handler_hash = 0;
+
+
+/* State when the file being assembled was started, and the hash it
+   will be cached under (0 if it will not be cached). */
+
+static image_header assembly_start;
+
+
+/* Vectors accumulated while writing an image: */
+
+static image_inst *insts;
+static int n_insts, insts_size;
+
+static image_span *spans;
+static int n_spans, spans_size;
+
+static label **labels;
+static image_label *image_labels;
+static int n_labels, labels_size;
+
+static image_use *uses;
+static int n_uses, uses_size;
+
+static BYTE_TYPE *data_bytes;
+static int data_size, data_bytes_size;
+
+static char *strings;
+static int strings_len, strings_size;
+
+
+
+/* If a valid image for the exception handler in FILE_NAMES (a list
+   separated by ';') exists, install its contents in memory and the
+   symbol table and return true.  Otherwise, return false and leave the
+   machine untouched. */
+
+bool
+install_handler_image (char *file_names)
+{
+  char *name = image_file_name (file_names);
+  unsigned long long hash = source_hash (file_names);
+  image_view v;
+
+  handler_hash = hash;
+  if (name == NULL)
+    return (false);
+  if (!map_image (name, &v))
+    {
+      free (name);
+      return (false);
+    }
+  free (name);
+
+  if ((v.hdr->flags & IMAGE_PROGRAM) != 0
+      || v.hdr->hash_lo != (uint32) hash
+      || v.hdr->hash_hi != (uint32) (hash >> 32)
+      || v.hdr->text_from != TEXT_BOT
+      || v.hdr->k_text_from != K_TEXT_BOT)
+    {
+      unmap_last_image ();
+      return (false);
+    }
+
+  restore_pcs (v.hdr);
+  install_image (&v);
+  return (true);
+}
+
+
+/* Return true if file NAME is a program image. */
+
+bool
+is_program_image (char *name)
+{
+  FILE *file = fopen (name, "rb");
+  image_header hdr;
+  bool is_image;
+
+  if (file == NULL)
+    return (false);
+  is_image = (fread (&hdr, sizeof (hdr), 1, file) == 1
+	      && hdr.magic == IMAGE_MAGIC
+	      && (hdr.flags & IMAGE_PROGRAM) != 0);
+  fclose (file);
+  return (is_image);
+}
+
+
+/* Load the program image in file NAME, which must have been written
+   with the same exception handler.  Return true if successful and
+   false otherwise. */
+
+bool
+read_program_image (char *name)
+{
+  image_view v;
+  mem_addr text_pc;
+
+  if (!map_image (name, &v))
+    {
+      error ("`%s' is not a valid program image\n", name);
+      return (false);
+    }
+  if ((v.hdr->flags & IMAGE_PROGRAM) == 0)
+    {
+      unmap_last_image ();
+      error ("`%s' is not a valid program image\n", name);
+      return (false);
+    }
+
+  text_pc = current_text_pc ();
+  if (v.hdr->hash_lo != (uint32) handler_hash
+      || v.hdr->hash_hi != (uint32) (handler_hash >> 32)
+      || text_pc > v.hdr->text_from || v.hdr->text_pc > text_top)
+    {
+      unmap_last_image ();
+      error ("`%s' was assembled with a different exception handler\n", name);
+      return (false);
+    }
+
+  user_kernel_data_segment (false);
+  set_data_pc (v.hdr->data_pc);
+  increment_data_pc (0);
+  user_kernel_text_segment (false);
+  set_text_pc (v.hdr->text_pc);
+  if (!bare_machine)
+    set_gp_item_addr (v.hdr->gp_pc);
+
+  install_image (&v);
+  return (true);
+}
+
+
+/* If the result of assembling source file NAME in the current state
+   is in the cache, install it and return true.  Otherwise, return
+   false and remember the state, so write_cached_assembly can save the
+   result once NAME has been assembled. */
+
+bool
+read_cached_assembly (char *name)
+{
+  char *dir = cache_directory ();
+  char *image_name;
+  unsigned long long hash;
+  image_view v;
+
+  memclr (&assembly_start, sizeof (assembly_start));
+  if (dir == NULL)
+    return (false);
+  save_pcs (&assembly_start);
+  hash = assembly_hash (name, &assembly_start);
+  if (hash == 0)
+    {
+      free (dir);
+      return (false);
+    }
+  assembly_start.hash_lo = (uint32) hash;
+  assembly_start.hash_hi = (uint32) (hash >> 32);
+
+  image_name = (char *) xmalloc ((int) strlen (dir) + 64);
+  sprintf (image_name, "%s/asm-%016llx.img", dir, hash);
+  free (dir);
+  if (!map_image (image_name, &v))
+    {
+      free (image_name);
+      return (false);
+    }
+#ifndef _WIN32
+  utime (image_name, NULL);	/* Record the use for prune_cache */
+#endif
+  free (image_name);
+
+  if ((v.hdr->flags & IMAGE_ASSEMBLY) == 0
+      || v.hdr->hash_lo != assembly_start.hash_lo
+      || v.hdr->hash_hi != assembly_start.hash_hi
+      || v.hdr->text_from != assembly_start.text_pc
+      || v.hdr->k_text_from != assembly_start.k_text_pc)
+    {
+      unmap_last_image ();
+      return (false);
+    }
+
+  memclr (&assembly_start, sizeof (assembly_start));
+  restore_pcs (v.hdr);
+  install_image (&v);
+  return (true);
+}
+
+
+/* Unmap all images.  Called when memory is reinitialized, since
+   instructions from the images have been discarded, and before a new
+   exception handler is loaded. */
+
+void
+unmap_images ()
+{
+  handler_hash = 0;
+  while (image_maps != NULL)
+    unmap_last_image ();
+}
+
+
+/* Save the state produced by assembling the exception handler in
+   FILE_NAMES as an image for later runs.  Quietly give up if the state
+   cannot be reproduced from an image or the image cannot be written. */
+
+void
+write_handler_image (char *file_names)
+{
+  char *name = image_file_name (file_names);
+  unsigned long long hash = source_hash (file_names);
+  image_header hdr;
+
+  if (name == NULL)
+    return;
+  if (hash == 0)
+    {
+      free (name);
+      return;
+    }
+
+  memclr (&hdr, sizeof (hdr));
+  save_pcs (&hdr);
+  if (collect_image (TEXT_BOT, hdr.text_pc, K_TEXT_BOT, hdr.k_text_pc,
+		     DATA_BOT, hdr.data_pc, K_DATA_BOT, hdr.k_data_pc, false))
+    {
+      hdr.hash_lo = (uint32) hash;
+      hdr.hash_hi = (uint32) (hash >> 32);
+      hdr.text_from = TEXT_BOT;
+      hdr.k_text_from = K_TEXT_BOT;
+      (void) write_image_file (name, &hdr);
+    }
+  free (name);
+}
+
+
+/* Save the result of assembling a file, which read_cached_assembly did
+   not find in the cache, under the hash that it computed.  Quietly give
+   up if the result cannot be reproduced from an image. */
+
+void
+write_cached_assembly ()
+{
+  char *dir;
+  char *name;
+  image_header hdr;
+
+  if (assembly_start.hash_lo == 0 && assembly_start.hash_hi == 0)
+    return;
+
+  memclr (&hdr, sizeof (hdr));
+  save_pcs (&hdr);
+  if (hdr.text_pc < assembly_start.text_pc
+      || hdr.k_text_pc < assembly_start.k_text_pc
+      || hdr.data_pc < assembly_start.data_pc
+      || hdr.k_data_pc < assembly_start.k_data_pc
+      || !collect_image (assembly_start.text_pc, hdr.text_pc,
+			 assembly_start.k_text_pc, hdr.k_text_pc,
+			 assembly_start.data_pc, hdr.data_pc,
+			 assembly_start.k_data_pc, hdr.k_data_pc, true))
+    {
+      memclr (&assembly_start, sizeof (assembly_start));
+      return;
+    }
+
+  hdr.hash_lo = assembly_start.hash_lo;
+  hdr.hash_hi = assembly_start.hash_hi;
+  hdr.flags |= IMAGE_ASSEMBLY;
+  hdr.text_from = assembly_start.text_pc;
+  hdr.k_text_from = assembly_start.k_text_pc;
+  memclr (&assembly_start, sizeof (assembly_start));
+
+  dir = cache_directory ();
+  if (dir == NULL)
+    return;
+  name = (char *) xmalloc ((int) strlen (dir) + 64);
+  sprintf (name, "%s/asm-%016llx.img", dir,
+	   ((unsigned long long) hdr.hash_hi << 32) | hdr.hash_lo);
+  if (write_image_file (name, &hdr))
+    prune_cache (dir);
+  free (name);
+  free (dir);
+}
+
+
+/* Write the user program that has been assembled as a program image in
+   file NAME.  Return true if successful and false otherwise. */
+
+bool
+write_program_image (char *name)
+{
+  mem_addr text_from = find_symbol_address (END_OF_TRAP_HANDLER_SYMBOL);
+  mem_addr text_pc, data_pc;
+  image_header hdr;
+
+  if (text_from == 0)
+    text_from = TEXT_BOT;	/* No exception handler */
+  user_kernel_text_segment (false);
+  text_pc = current_text_pc ();
+  user_kernel_data_segment (false);
+  data_pc = current_data_pc ();
+
+  if (!collect_image (text_from, text_pc, K_TEXT_BOT, K_TEXT_BOT,
+		      DATA_BOT, data_pc, K_DATA_BOT, K_DATA_BOT, true))
+    {
+      error ("Cannot represent the program in `%s' as an image\n", name);
+      return (false);
+    }
+
+  memclr (&hdr, sizeof (hdr));
+  hdr.flags = IMAGE_PROGRAM;
+  hdr.hash_lo = (uint32) handler_hash;
+  hdr.hash_hi = (uint32) (handler_hash >> 32);
+  hdr.text_from = text_from;
+  hdr.k_text_from = K_TEXT_BOT;
+  hdr.text_pc = text_pc;
+  hdr.k_text_pc = K_TEXT_BOT;
+  hdr.data_pc = data_pc;
+  hdr.k_data_pc = K_DATA_BOT;
+  hdr.gp_pc = bare_machine ? 0 : current_gp_item_addr ();
+  if (!write_image_file (name, &hdr))
+    {
+      error ("Cannot write image file: `%s'\n", name);
+      return (false);
+    }
+  return (true);
+}
+
+
+/* Record the labels, instructions from TEXT_FROM to TEXT_PC and
+   K_TEXT_FROM to K_TEXT_PC, and the data from DATA_FROM to DATA_PC and
+   K_DATA_FROM to K_DATA_PC.
+   Uses of labels by instructions outside those ranges belong to code
+   that is not in the image and are skipped.  Return false if the state
+   cannot be reproduced from an image. */
+
+static bool
+collect_image (mem_addr text_from, mem_addr text_pc,
+	       mem_addr k_text_from, mem_addr k_text_pc,
+	       mem_addr data_from, mem_addr data_pc,
+	       mem_addr k_data_from, mem_addr k_data_pc, bool allow_gp)
+{
+  label **table;
+  int n_table;
+  label_use *label_uses;
+  int n_label_uses;
+  bool ok = true;
+  int i, j;
+
+  n_insts = n_spans = n_labels = n_uses = data_size = strings_len = 0;
+  add_string ((char *) "");	/* Offset 0 is the empty string */
+
+  table = symbol_table_contents (&n_table);
+  label_uses = recorded_label_uses (&n_label_uses);
+  for (i = 0; ok && i < n_table; i++)
+    {
+      uint32 index = add_label (table[i]);
+
+      image_labels[index].flags |= LABEL_IN_TABLE;
+      if (table[i]->gp_flag && !allow_gp)
+	ok = false;
+
+      for (j = 0; ok && table[i]->n_uses != 0 && j < n_label_uses; j++)
+	{
+	  label_use *u = &label_uses[j];
+
+	  if (u->sym != table[i])
+	    continue;
+	  else if (u->inst != NULL)
+	    {
+	      if (!in_text_segment (u->addr))
+		ok = false;	/* Instruction in data segment */
+	      else if (!((text_from <= u->addr && u->addr < text_pc)
+			 || (k_text_from <= u->addr && u->addr < k_text_pc)))
+		continue;
+	      else if (read_mem_inst (u->addr) != u->inst)
+		ok = false;
+	    }
+	  if (ok)
+	    {
+	      uses = (image_use *) grow_vector (uses, n_uses, &uses_size,
+						sizeof (image_use));
+	      uses[n_uses].label = index;
+	      uses[n_uses].addr = u->addr;
+	      uses[n_uses].is_inst = (u->inst != NULL);
+	      n_uses += 1;
+	    }
+	}
+    }
+  free (table);
+
+  ok = (ok
+	&& add_insts (text_from, text_pc)
+	&& add_insts (k_text_from, k_text_pc));
+  add_data_span (data_from, data_pc);
+  add_data_span (k_data_from, k_data_pc);
+  return (ok);
+}
+
+
+/* Write the collected vectors, preceded by HDR, to file NAME.  A new
+   file is written and renamed, so a mapped image never changes under
+   another SPIM.  Return true if successful. */
+
+static bool
+write_image_file (char *name, image_header *hdr)
+{
+  char *tmp_name;
+  FILE *file;
+  bool ok;
+
+  hdr->magic = IMAGE_MAGIC;
+  hdr->version = IMAGE_VERSION;
+  hdr->n_insts = n_insts;
+  hdr->n_spans = n_spans;
+  hdr->n_labels = n_labels;
+  hdr->n_uses = n_uses;
+  hdr->data_size = data_size;
+  hdr->strings_size = strings_len;
+
+  tmp_name = (char *) xmalloc ((int) strlen (name) + 32);
+  sprintf (tmp_name, "%s.%d", name, (int) getpid ());
+  file = fopen (tmp_name, "wb");
+  if (file == NULL)
+    {
+      free (tmp_name);
+      return (false);
+    }
+  ok = (fwrite (hdr, sizeof (image_header), 1, file) == 1
+	&& fwrite (insts, sizeof (image_inst), n_insts, file) == (size_t) n_insts
+	&& fwrite (spans, sizeof (image_span), n_spans, file) == (size_t) n_spans
+	&& fwrite (image_labels, sizeof (image_label), n_labels, file) == (size_t) n_labels
+	&& fwrite (uses, sizeof (image_use), n_uses, file) == (size_t) n_uses
+	&& fwrite (data_bytes, 1, data_size, file) == (size_t) data_size
+	&& fwrite (strings, 1, strings_len, file) == (size_t) strings_len);
+  if (fclose (file) != 0)
+    ok = false;
+  if (!ok || rename (tmp_name, name) != 0)
+    {
+      unlink (tmp_name);
+      ok = false;
+    }
+  free (tmp_name);
+  return (ok);
+}
+
+
+/* Map the image in file NAME and check that it is well-formed.  Return
+   true and set the sections of V if successful. */
+
+static bool
+map_image (char *name, image_view *v)
+{
+#ifdef _WIN32
+  return (false);
+#else
+  image_map *m;
+  struct stat st;
+  void *addr;
+  int fd;
+
+  fd = open (name, O_RDONLY);
+  if (fd < 0)
+    return (false);
+  if (fstat (fd, &st) != 0 || (size_t) st.st_size < sizeof (image_header))
+    {
+      close (fd);
+      return (false);
+    }
+  addr = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (addr == MAP_FAILED)
+    return (false);
+
+  m = (image_map *) xmalloc (sizeof (image_map));
+  m->addr = addr;
+  m->size = (size_t) st.st_size;
+  m->next = image_maps;
+  image_maps = m;
+
+  if (!image_is_well_formed (addr, m->size, v))
+    {
+      unmap_last_image ();
+      return (false);
+    }
+  return (true);
+#endif
+}
+
+
+/* Return true if the SIZE bytes at ADDR are a well-formed image whose
+   addresses fit in memory, and set the sections of V. */
+
+static bool
+image_is_well_formed (void *addr, size_t size, image_view *v)
+{
+  image_header *hdr = (image_header *) addr;
+  size_t len;
+  uint32 i;
+
+  v->hdr = hdr;
+  if (hdr->magic != IMAGE_MAGIC || hdr->version != IMAGE_VERSION)
+    return (false);
+
+  len = sizeof (image_header);
+  v->insts = (image_inst *) ((char *) addr + len);
+  len += (size_t) hdr->n_insts * sizeof (image_inst);
+  v->spans = (image_span *) ((char *) addr + len);
+  len += (size_t) hdr->n_spans * sizeof (image_span);
+  v->labels = (image_label *) ((char *) addr + len);
+  len += (size_t) hdr->n_labels * sizeof (image_label);
+  v->uses = (image_use *) ((char *) addr + len);
+  len += (size_t) hdr->n_uses * sizeof (image_use);
+  v->data = (BYTE_TYPE *) addr + len;
+  len += hdr->data_size;
+  v->strings = (char *) addr + len;
+  len += hdr->strings_size;
+
+  if (len != size
+      || hdr->strings_size == 0
+      || v->strings[hdr->strings_size - 1] != '\0'
+      || hdr->text_from < TEXT_BOT || hdr->text_pc < hdr->text_from
+      || text_top < hdr->text_pc
+      || hdr->k_text_from < K_TEXT_BOT || hdr->k_text_pc < hdr->k_text_from
+      || k_text_top < hdr->k_text_pc
+      || hdr->data_pc < DATA_BOT || hdr->k_data_pc < K_DATA_BOT)
+    return (false);
+
+  for (i = 0; i < hdr->n_insts; i++)
+    {
+      mem_addr iaddr = v->insts[i].addr;
+
+      if ((iaddr & 0x3) != 0
+	  || !((hdr->text_from <= iaddr && iaddr < hdr->text_pc)
+	       || (hdr->k_text_from <= iaddr && iaddr < hdr->k_text_pc))
+	  || (v->insts[i].source != NO_INDEX
+	      && v->insts[i].source >= hdr->strings_size)
+	  || (v->insts[i].symbol != NO_INDEX
+	      && v->insts[i].symbol >= hdr->n_labels))
+	return (false);
+    }
+  for (i = 0; i < hdr->n_spans; i++)
+    {
+      mem_addr from = v->spans[i].addr;
+      mem_addr to = from + v->spans[i].length;
+
+      if (to < from
+	  || v->spans[i].offset > hdr->data_size
+	  || v->spans[i].length > hdr->data_size - v->spans[i].offset
+	  || !((DATA_BOT <= from && to <= hdr->data_pc)
+	       || (K_DATA_BOT <= from && to <= hdr->k_data_pc)))
+	return (false);
+    }
+  for (i = 0; i < hdr->n_labels; i++)
+    if (v->labels[i].name >= hdr->strings_size)
+      return (false);
+  for (i = 0; i < hdr->n_uses; i++)
+    if (v->uses[i].label >= hdr->n_labels
+	|| (v->uses[i].is_inst
+	    && !((hdr->text_from <= v->uses[i].addr
+		  && v->uses[i].addr < hdr->text_pc)
+		 || (hdr->k_text_from <= v->uses[i].addr
+		     && v->uses[i].addr < hdr->k_text_pc))))
+      return (false);
+
+  return (true);
+}
+
+
+/* Install the instructions, data, and labels of the mapped image V.
+   Labels that the image defines resolve earlier references to them. */
+
+static void
+install_image (image_view *v)
+{
+  image_header *hdr = v->hdr;
+  label **lbls;
+  uint32 i;
+
+  lbls = (label **) xmalloc ((hdr->n_labels + 1) * sizeof (label *));
+  for (i = 0; i < hdr->n_labels; i++)
+    {
+      image_label *il = &v->labels[i];
+      label *l;
+
+      if (il->flags & LABEL_IN_TABLE)
+	l = lookup_label (v->strings + il->name);
+      else
+	{
+	  /* Local label, flushed from the table after assembly. */
+	  l = (label *) arena_alloc (sizeof (label));
+	  l->name = str_copy (v->strings + il->name);
+	}
+      if (il->addr != 0 || l->addr == 0)
+	set_label_address (l, il->addr);
+      l->global_flag |= (il->flags & LABEL_GLOBAL) != 0;
+      l->gp_flag |= (il->flags & LABEL_GP) != 0;
+      l->const_flag |= (il->flags & LABEL_CONST) != 0;
+      lbls[i] = l;
+    }
+
+  for (i = 0; i < hdr->n_insts; i++)
+    {
+      image_inst *ii = &v->insts[i];
+      instruction *inst = inst_decode (ii->encoding);
+
+      if (ii->source != NO_INDEX)
+	set_image_source (inst, v->strings + ii->source);
+      if (ii->flags & INST_HAS_EXPR)
+	{
+	  imm_expr *expr = (imm_expr *) arena_alloc (sizeof (imm_expr));
+
+	  expr->offset = ii->offset;
+	  expr->symbol = (ii->symbol == NO_INDEX) ? NULL : lbls[ii->symbol];
+	  expr->bits = (short) ii->bits;
+	  expr->pc_relative = (ii->flags & INST_PC_RELATIVE) != 0;
+	  SET_EXPR (inst, expr);
+	}
+      set_mem_inst (ii->addr, inst);
+    }
+
+  for (i = 0; i < hdr->n_spans; i++)
+    {
+      uint32 j;
+
+      for (j = 0; j < v->spans[i].length; j++)
+	set_mem_byte (v->spans[i].addr + j, v->data[v->spans[i].offset + j]);
+    }
+
+  /* References already in memory (from the exception handler) to labels
+     the image defines. */
+  resolve_label_uses ();
+
+  /* Uses by data that was already in memory may have been recorded
+     already. */
+  for (i = 0; i < hdr->n_uses; i++)
+    {
+      image_use *iu = &v->uses[i];
+      label *sym = lbls[iu->label];
+
+      if (!iu->is_inst && sym->n_uses != 0)
+	{
+	  label_use *label_uses;
+	  int n_label_uses;
+	  int j;
+
+	  label_uses = recorded_label_uses (&n_label_uses);
+	  for (j = 0; j < n_label_uses; j++)
+	    if (label_uses[j].sym == sym
+		&& label_uses[j].inst == NULL
+		&& label_uses[j].addr == iu->addr)
+	      break;
+	  if (j < n_label_uses)
+	    continue;
+	}
+
+      record_label_use (sym, iu->is_inst ? read_mem_inst (iu->addr) : NULL,
+			iu->addr);
+    }
+  free (lbls);
+}
+
+
+/* Record the text and data PCs, and the $gp allocation pointer, in
+   HDR.  Leaves the assembler in the user data segment. */
+
+static void
+save_pcs (image_header *hdr)
+{
+  mem_addr cur_text_pc = current_text_pc ();
+
+  user_kernel_text_segment (true);
+  hdr->k_text_pc = current_text_pc ();
+  user_kernel_text_segment (false);
+  hdr->text_pc = current_text_pc ();
+  user_kernel_text_segment (cur_text_pc == hdr->k_text_pc);
+  if (cur_text_pc == hdr->k_text_pc)
+    hdr->flags |= IMAGE_IN_KTEXT;
+
+  user_kernel_data_segment (true);
+  hdr->k_data_pc = current_data_pc ();
+  user_kernel_data_segment (false);
+  hdr->data_pc = current_data_pc ();
+  hdr->gp_pc = bare_machine ? 0 : current_gp_item_addr ();
+}
+
+
+/* Set the text and data PCs, and the $gp allocation pointer, from HDR.
+   The data PCs are set first, so the data segments expand as they did
+   when the image was written. */
+
+static void
+restore_pcs (image_header *hdr)
+{
+  user_kernel_data_segment (true);
+  set_data_pc (hdr->k_data_pc);
+  increment_data_pc (0);
+  user_kernel_data_segment (false);
+  set_data_pc (hdr->data_pc);
+  increment_data_pc (0);
+  if (!bare_machine)
+    set_gp_item_addr (hdr->gp_pc);
+
+  user_kernel_text_segment (true);
+  set_text_pc (hdr->k_text_pc);
+  user_kernel_text_segment (false);
+  set_text_pc (hdr->text_pc);
+  user_kernel_text_segment ((hdr->flags & IMAGE_IN_KTEXT) != 0);
+}
+
+
+/* Record the bytes of the data segment from FROM to TO, trimmed to the
+   part that is not zero (memory starts out cleared). */
+
+static void
+add_data_span (mem_addr from, mem_addr to)
+{
+  mem_addr addr;
+
+  while (from < to && read_mem_byte (from) == 0)
+    from += 1;
+  while (from < to && read_mem_byte (to - 1) == 0)
+    to -= 1;
+  if (from == to)
+    return;
+
+  spans = (image_span *) grow_vector (spans, n_spans, &spans_size,
+				      sizeof (image_span));
+  spans[n_spans].addr = from;
+  spans[n_spans].length = to - from;
+  spans[n_spans].offset = data_size;
+  n_spans += 1;
+
+  for (addr = from; addr < to; addr++)
+    {
+      data_bytes = (BYTE_TYPE *) grow_vector (data_bytes, data_size,
+					      &data_bytes_size, 1);
+      data_bytes[data_size++] = (BYTE_TYPE) read_mem_byte (addr);
+    }
+}
+
+
+/* Record the instructions in the text segment from FROM to TO.  Return
+   false if one of them cannot be reproduced from its encoding. */
+
+static bool
+add_insts (mem_addr from, mem_addr to)
+{
+  mem_addr addr;
+
+  for (addr = from; addr < to; addr += BYTES_PER_WORD)
+    {
+      instruction *inst = read_mem_inst (addr);
+      instruction *decoded;
+      image_inst *ii;
+      bool same;
+
+      if (inst == NULL)
+	continue;
+
+      decoded = inst_decode (ENCODING (inst));
+      same = (OPCODE (decoded) == OPCODE (inst)
+	      && TARGET (decoded) == TARGET (inst));
+      free_inst (decoded);
+      if (!same)
+	return (false);
+
+      insts = (image_inst *) grow_vector (insts, n_insts, &insts_size,
+					  sizeof (image_inst));
+      ii = &insts[n_insts++];
+      ii->addr = addr;
+      ii->encoding = ENCODING (inst);
+      ii->source = (SOURCE (inst) == NULL ? NO_INDEX : add_source (inst));
+      ii->flags = 0;
+      ii->symbol = NO_INDEX;
+      ii->offset = 0;
+      ii->bits = 0;
+      if (EXPR (inst) != NULL)
+	{
+	  ii->flags |= INST_HAS_EXPR;
+	  if (EXPR (inst)->pc_relative)
+	    ii->flags |= INST_PC_RELATIVE;
+	  if (EXPR (inst)->symbol != NULL)
+	    ii->symbol = add_label (EXPR (inst)->symbol);
+	  ii->offset = EXPR (inst)->offset;
+	  ii->bits = EXPR (inst)->bits;
+	}
+    }
+  return (true);
+}
+
+
+/* Return the index of label L in the image, adding it if necessary. */
+
+static uint32
+add_label (label *l)
+{
+  int i;
+
+  for (i = 0; i < n_labels; i++)
+    if (labels[i] == l)
+      return (i);
+
+  labels = (label **) grow_vector (labels, n_labels, &labels_size,
+				   sizeof (label *));
+  /* IMAGE_LABELS is kept the same size as LABELS. */
+  image_labels = (image_label *) realloc (image_labels,
+					   labels_size * sizeof (image_label));
+  if (image_labels == NULL)
+    fatal_error ("Out of memory at request for %d bytes.\n",
+		 labels_size * (int) sizeof (image_label));
+  labels[n_labels] = l;
+  image_labels[n_labels].name = add_string (l->name);
+  image_labels[n_labels].addr = l->addr;
+  image_labels[n_labels].flags = ((l->global_flag ? LABEL_GLOBAL : 0)
+				  | (l->gp_flag ? LABEL_GP : 0)
+				  | (l->const_flag ? LABEL_CONST : 0));
+  return (n_labels++);
+}
+
+
+/* Add the source line of INST, with its line number, to the string
+   table and return its offset. */
+
+static uint32
+add_source (instruction *inst)
+{
+  char *str = (char *) xmalloc (SOURCE_LENGTH (inst) + 16);
+  uint32 offset;
+
+  sprintf (str, "%d: %.*s", SOURCE_LINE_NO (inst), SOURCE_LENGTH (inst),
+	   SOURCE (inst));
+  offset = add_string (str);
+  free (str);
+  return (offset);
+}
+
+
+/* Set the source line of INST to STR, a line from add_source in a
+   mapped image. */
+
+static void
+set_image_source (instruction *inst, char *str)
+{
+  char *text;
+  long line = strtol (str, &text, 10);
+
+  if (text[0] == ':' && text[1] == ' ')
+    text += 2;
+  else
+    {
+      text = str;
+      line = 0;
+    }
+  SET_SOURCE (inst, text, strlen (text), line);
+}
+
+
+/* Add STR to the string table and return its offset. */
+
+static uint32
+add_string (char *str)
+{
+  int len = (int) strlen (str) + 1;
+  int offset = strings_len;
+
+  while (strings_len + len > strings_size)
+    strings = (char *) grow_vector (strings, strings_size, &strings_size, 1);
+  memcpy (strings + strings_len, str, len);
+  strings_len += len;
+  return (offset);
+}
+
+
+/* Return VEC, reallocated if necessary to hold one more than its N
+   elements of ELEM_SIZE bytes.  SIZE is its current capacity. */
+
+static void *
+grow_vector (void *vec, int n, int *size, int elem_size)
+{
+  if (n < *size)
+    return (vec);
+
+  *size = (*size == 0) ? 64 : 2 * *size;
+  vec = realloc (vec, *size * elem_size);
+  if (vec == NULL)
+    fatal_error ("Out of memory at request for %d bytes.\n", *size * elem_size);
+  return (vec);
+}
+
+
+/* Return the directory that holds cached images, or NULL if caching is
+   disabled.  Images live in $SPIM_CACHE_DIR, or $HOME/.cache/spim. */
+
+static char *
+cache_directory ()
+{
+#ifdef _WIN32
+  return (NULL);
+#else
+  char *dir = getenv ("SPIM_CACHE_DIR");
+  char *home = getenv ("HOME");
+
+  if (dir == NULL)
+    {
+      if (home == NULL || *home == '\0')
+	return (NULL);
+      dir = (char *) xmalloc ((int) strlen (home) + 64);
+      sprintf (dir, "%s/.cache", home);
+      mkdir (dir, 0755);
+      strcat (dir, "/spim");
+    }
+  else if (*dir == '\0')
+    return (NULL);		/* Caching disabled */
+  else
+    dir = str_copy (dir);
+  mkdir (dir, 0755);
+  return (dir);
+#endif
+}
+
+
+/* Remove the least recently used assembly images from cache directory
+   DIR until it holds at most MAX_CACHED_ASSEMBLIES of them, totalling
+   at most MAX_CACHED_BYTES. */
+
+static void
+prune_cache (char *dir)
+{
+#ifndef _WIN32
+  DIR *d = opendir (dir);
+  struct dirent *entry;
+  cached_image *images = NULL;
+  int n_images = 0, images_size = 0;
+  off_t total = 0;
+  int i;
+
+  if (d == NULL)
+    return;
+  while ((entry = readdir (d)) != NULL)
+    {
+      char *name;
+      struct stat st;
+
+      if (strncmp (entry->d_name, "asm-", 4) != 0
+	  || strcmp (entry->d_name + strlen (entry->d_name) - 4, ".img") != 0)
+	continue;
+      name = (char *) xmalloc ((int) (strlen (dir) + strlen (entry->d_name)) + 2);
+      sprintf (name, "%s/%s", dir, entry->d_name);
+      if (stat (name, &st) != 0)
+	{
+	  free (name);
+	  continue;
+	}
+      images = (cached_image *) grow_vector (images, n_images, &images_size,
+					     sizeof (cached_image));
+      images[n_images].name = name;
+      images[n_images].used = st.st_mtime;
+      images[n_images].size = st.st_size;
+      total += st.st_size;
+      n_images += 1;
+    }
+  closedir (d);
+
+  qsort (images, n_images, sizeof (cached_image), compare_cached_images);
+  for (i = 0; i < n_images; i++)
+    {
+      if (n_images - i > MAX_CACHED_ASSEMBLIES || total > MAX_CACHED_BYTES)
+	{
+	  unlink (images[i].name);
+	  total -= images[i].size;
+	}
+      free (images[i].name);
+    }
+  free (images);
+#endif
+}
+
+
+/* Order cached images from least to most recently used. */
+
+static int
+compare_cached_images (const void *p1, const void *p2)
+{
+  time_t u1 = ((cached_image *) p1)->used;
+  time_t u2 = ((cached_image *) p2)->used;
+
+  return (u1 < u2 ? -1 : (u1 > u2 ? 1 : 0));
+}
+
+
+/* Return the name of the image file for the exception handler in
+   FILE_NAMES, or NULL if there is no cache directory.  Handler images
+   are named after a hash of the handler's file names. */
+
+static char *
+image_file_name (char *file_names)
+{
+  char *dir = cache_directory ();
+  char *name;
+  unsigned long long hash;
+
+  if (dir == NULL)
+    return (NULL);
+
+  hash = hash_bytes (0xcbf29ce484222325ULL, file_names, strlen (file_names));
+  name = (char *) xmalloc ((int) strlen (dir) + 64);
+  sprintf (name, "%s/handler-%016llx.img", dir, hash);
+  free (dir);
+  return (name);
+}
+
+
+/* Return a hash of the contents of the files in FILE_NAMES and of the
+   settings that affect how they assemble, or 0 if a file cannot be
+   read. */
+
+static unsigned long long
+source_hash (char *file_names)
+{
+  unsigned long long hash = 0xcbf29ce484222325ULL; /* FNV-1a */
+  char *files = str_copy (file_names);
+  char *filename;
+  uint32 settings[3];
+
+  settings[0] = IMAGE_VERSION;
+  settings[1] = delayed_branches;
+  settings[2] = sizeof (instruction);
+  hash = hash_bytes (hash, settings, sizeof (settings));
+
+  for (filename = strtok (files, ";"); filename != NULL; filename = strtok (NULL, ";"))
+    if (!hash_file (filename, &hash))
+      {
+	free (files);
+	return (0);
+      }
+  free (files);
+  return (hash == 0 ? 1 : hash);
+}
+
+
+/* Return the hash that the assembly of source file NAME is cached
+   under, or 0 if the file cannot be read.  Besides the file, it covers
+   the settings that affect how the file assembles and the state START
+   (PCs and the symbol table) that the file is assembled in. */
+
+static unsigned long long
+assembly_hash (char *name, image_header *start)
+{
+  unsigned long long hash = 0xcbf29ce484222325ULL; /* FNV-1a */
+  uint32 settings[6];
+  label **table;
+  int n_table;
+  int i;
+
+  settings[0] = IMAGE_VERSION;
+  settings[1] = delayed_branches;
+  settings[2] = bare_machine;
+  settings[3] = accept_pseudo_insts;
+  settings[4] = sizeof (instruction);
+  settings[5] = R[REG_GP];
+  hash = hash_bytes (hash, settings, sizeof (settings));
+  hash = hash_bytes (hash, start, sizeof (image_header));
+
+  table = symbol_table_contents (&n_table);
+  for (i = 0; i < n_table; i++)
+    {
+      uint32 sym[2];
+
+      sym[0] = table[i]->addr;
+      sym[1] = ((table[i]->global_flag ? LABEL_GLOBAL : 0)
+		| (table[i]->gp_flag ? LABEL_GP : 0)
+		| (table[i]->const_flag ? LABEL_CONST : 0));
+      hash = hash_bytes (hash, table[i]->name, strlen (table[i]->name) + 1);
+      hash = hash_bytes (hash, sym, sizeof (sym));
+    }
+  free (table);
+
+  if (!hash_file (name, &hash))
+    return (0);
+  return (hash == 0 ? 1 : hash);
+}
+
+
+/* Return HASH extended with the N BYTES. */
+
+static unsigned long long
+hash_bytes (unsigned long long hash, const void *bytes, size_t n)
+{
+  const unsigned char *p = (const unsigned char *) bytes;
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    hash = (hash ^ p[i]) * 0x100000001b3ULL;
+  return (hash);
+}
+
+
+/* Extend *HASH with the contents of file NAME.  Return false if the
+   file cannot be read. */
+
+static bool
+hash_file (char *name, unsigned long long *hash)
+{
+  FILE *file = fopen (name, "rb");
+  char buf[8192];
+  size_t n;
+
+  if (file == NULL)
+    return (false);
+  while ((n = fread (buf, 1, sizeof (buf), file)) > 0)
+    *hash = hash_bytes (*hash, buf, n);
+  fclose (file);
+  *hash = (*hash ^ 0xff) * 0x100000001b3ULL; /* End of file */
+  return (true);
+}
+
+
+/* Return true if ADDR is in the user or kernel text segment. */
+
+static bool
+in_text_segment (mem_addr addr)
+{
+  return ((TEXT_BOT <= addr && addr < text_top)
+	  || (K_TEXT_BOT <= addr && addr < k_text_top));
+}
+
+
+/* Unmap the most recently mapped image. */
+
+static void
+unmap_last_image ()
+{
+  image_map *m = image_maps;
+
+  if (m != NULL)
+    {
+#ifndef _WIN32
+      munmap (m->addr, m->size);
+#endif
+      image_maps = m->next;
+      free (m);
+    }
+}
@@ -49,7 +49,7 @@
 
 /* Local functions: */
 
-static int compare_pair_value (name_val_val *p1, name_val_val *p2);
+static constexpr int decode_slot (int32 val, int32 *key);
 static void format_imm_expr (str_stream *ss, imm_expr *expr, int base_reg);
 static void i_type_inst_full_word (int opcode, int rt, int rs, imm_expr *expr,
 				   int value_known, int32 value);
@@ -60,9 +60,7 @@ static instruction *mk_j_inst (int32 value, int opcode, int target);
 static instruction *mk_r_inst (int32 value, int opcode, int rs, int rt, int rd, int shamt);
 static instruction *mk_co_r_inst (int32 value, int opcode, int fd, int fs, int ft);
 static void produce_immediate (imm_expr *expr, int rt, int value_known, int32 value);
-static void sort_a_opcode_table ();
-static void sort_i_opcode_table ();
-static void sort_name_table ();
+static name_val_val *opcode_entry (int opcode);
 
 
 /* Local variables: */
@@ -169,12 +167,18 @@ store_instruction (instruction *inst)
       exception_occurred = 0;
       set_mem_inst (INST_PC, inst);
       if (exception_occurred)
-	error ("Invalid address (0x%08x) for instruction\n", INST_PC);
+	{
+	  error ("Invalid address (0x%08x) for instruction\n", INST_PC);
+	  parse_warning_occurred = true;
+	}
       else
 	increment_text_pc (BYTES_PER_WORD);
       if (inst != NULL)
 	{
-	  SET_SOURCE (inst, source_line ());
+	  int length = 0, line = 0;
+	  char *text = source_line (&length, &line);
+
+	  SET_SOURCE (inst, text, length, line);
 	  if (ENCODING (inst) == 0)
 	    SET_ENCODING (inst, inst_encode (inst));
 	}
@@ -187,7 +191,7 @@ void
 i_type_inst_free (int opcode, int rt, int rs, imm_expr *expr)
 {
   i_type_inst (opcode, rt, rs, expr);
-  free (expr);
+  arena_free (expr, sizeof (imm_expr));
 }
 
 
@@ -200,7 +204,7 @@ i_type_inst_free (int opcode, int rt, int rs, imm_expr *expr)
 void
 i_type_inst (int opcode, int rt, int rs, imm_expr *expr)
 {
-  instruction *inst = (instruction *) zmalloc (sizeof (instruction));
+  instruction *inst = (instruction *) arena_alloc (sizeof (instruction));
 
   SET_OPCODE (inst, opcode);
   SET_RS (inst, rs);
@@ -381,7 +385,7 @@ produce_immediate (imm_expr *expr, int rt, int value_known, int32 value)
 void
 j_type_inst (int opcode, imm_expr *target)
 {
-  instruction *inst = (instruction *) zmalloc (sizeof (instruction));
+  instruction *inst = (instruction *) arena_alloc (sizeof (instruction));
 
   SET_OPCODE(inst, opcode);
   target->offset = 0;		/* Not PC relative */
@@ -401,7 +405,7 @@ j_type_inst (int opcode, imm_expr *target)
 static instruction *
 make_r_type_inst (int opcode, int rd, int rs, int rt)
 {
-  instruction *inst = (instruction *) zmalloc (sizeof (instruction));
+  instruction *inst = (instruction *) arena_alloc (sizeof (instruction));
 
   SET_OPCODE(inst, opcode);
   SET_RS(inst, rs);
@@ -577,7 +581,7 @@ r_cond_type_inst (int opcode, int fs, int ft, int cc)
 instruction *
 copy_inst (instruction *inst)
 {
-  instruction *new_inst = (instruction *) xmalloc (sizeof (instruction));
+  instruction *new_inst = (instruction *) arena_alloc (sizeof (instruction));
 
   *new_inst = *inst;
   /*memcpy ((void*)new_inst, (void*)inst , sizeof (instruction));*/
@@ -593,64 +597,228 @@ free_inst (instruction *inst)
     /* Don't free the breakpoint insructions since we only have one. */
     {
       if (EXPR (inst))
-	free (EXPR (inst));
-      free (inst);
+	arena_free (EXPR (inst), sizeof (imm_expr));
+      arena_free (inst, sizeof (instruction));
     }
 }
 
 
 
-/* Maintain a table mapping from opcode to instruction name and
-   instruction type.
+/* Maintain tables mapping from opcode to instruction name and
+   instruction type, and from an instruction's binary encoding back to
+   its opcode.  Both are direct-indexed arrays, built from op.h at compile time, so
+   encoding and decoding an instruction does not search. */
 
-   Table must be sorted before first use since its entries are
-   alphabetical on name, not ordered by opcode. */
 
+/* Map from opcode -> name/type.  Entries are in op.h order. */
 
-/* Sort all instruction table before first use. */
+static name_val_val name_tbl [] = {
+#undef OP
+#define OP(NAME, OPCODE, TYPE, R_OPCODE) {NAME, OPCODE, TYPE},
+#include "op.h"
+};
 
-void
-initialize_inst_tables ()
-{
-	sort_name_table ();
-	sort_i_opcode_table ();
-	sort_a_opcode_table ();
-}
+#define N_OPS ((int) (sizeof (name_tbl) / sizeof (name_val_val)))
 
 
-/* Map from opcode -> name/type. */
+/* Internal opcode, type, and real opcode of each op.h entry.  Parallel
+   to NAME_TBL, but without the names, so it is a constant expression
+   that the indexes below can be built from. */
 
-static name_val_val name_tbl [] = {
+typedef struct
+{
+  int opcode;
+  int type;
+  int32 a_opcode;
+} op_encoding;
+
+static constexpr op_encoding op_encodings [] = {
 #undef OP
-#define OP(NAME, OPCODE, TYPE, R_OPCODE) {NAME, OPCODE, TYPE},
+#define OP(NAME, I_OPCODE, TYPE, A_OPCODE) {I_OPCODE, TYPE, (int32)A_OPCODE},
 #include "op.h"
 };
 
 
-/* Sort the opcode table on their key (the opcode value). */
+static constexpr int
+min_op_opcode ()
+{
+  int min = op_encodings[0].opcode;
+  int i = 0;
 
-static void
-sort_name_table ()
+  for (i = 1; i < N_OPS; i++)
+    if (op_encodings[i].opcode < min)
+      min = op_encodings[i].opcode;
+  return (min);
+}
+
+
+static constexpr int
+max_op_opcode ()
 {
-  qsort (name_tbl,
-	 sizeof (name_tbl) / sizeof (name_val_val),
-	 sizeof (name_val_val),
-	 (QSORT_FUNC) compare_pair_value);
+  int max = op_encodings[0].opcode;
+  int i = 0;
+
+  for (i = 1; i < N_OPS; i++)
+    if (op_encodings[i].opcode > max)
+      max = op_encodings[i].opcode;
+  return (max);
 }
 
+#define MIN_OPCODE	(min_op_opcode ())
+#define MAX_OPCODE	(max_op_opcode ())
 
-/* Compare the VALUE1 field of two NAME_VAL_VAL entries in the format
-   required by qsort. */
 
-static int
-compare_pair_value (name_val_val *p1, name_val_val *p2)
+/* The slots of BY_ENCODING are laid out by field class: primary opcode,
+   SPECIAL, SPECIAL2, REGIMM, COP0, COP1, COP2, and COP1X. */
+
+#define SLOT_SPECIAL	64
+#define SLOT_SPECIAL2	(SLOT_SPECIAL + 64)
+#define SLOT_REGIMM	(SLOT_SPECIAL2 + 64)
+#define SLOT_COP0	(SLOT_REGIMM + 32)
+#define SLOT_COP1	(SLOT_COP0 + 32 * 32)
+#define SLOT_COP2	(SLOT_COP1 + 32 * 64)
+#define SLOT_COP1X	(SLOT_COP2 + 32)
+#define DECODE_SLOTS	(SLOT_COP1X + 32)
+
+
+/* Map an instruction's binary encoding VAL to its slot in BY_ENCODING.
+   The slot depends only on the fields that identify the instruction,
+   which are also stored in *KEY_OUT. */
+
+static constexpr int
+decode_slot (int32 val, int32 *key_out)
 {
-  if (p1->value1 < p2->value1)
-    return (-1);
-  else if (p1->value1 > p2->value1)
-    return (1);
-  else
-    return (0);
+  int32 key = val & 0xfc000000;
+  int rs = (val >> 21) & 0x1f;
+  int slot = 0;
+
+  /* Field classes: (opcode is continued in other part of instruction): */
+  switch ((val >> 26) & 0x3f)
+    {
+    case 0x00:					/* SPECIAL */
+      key |= (val & 0x3f);
+      slot = SLOT_SPECIAL + (val & 0x3f);
+      break;
+
+    case 0x1c:					/* SPECIAL2 */
+      key |= (val & 0x3f);
+      slot = SLOT_SPECIAL2 + (val & 0x3f);
+      break;
+
+    case 0x01:					/* REGIMM */
+      key |= (val & 0x001f0000);
+      slot = SLOT_REGIMM + ((val >> 16) & 0x1f);
+      break;
+
+    case 0x10:					/* COP0 */
+      key |= (val & 0x03e00000) | (val & 0x1f);
+      slot = SLOT_COP0 + (rs << 5) + (val & 0x1f);
+      break;
+
+    case 0x11:					/* COP1 */
+      key |= (val & 0x03e00000);
+      if ((val & 0xff000000) == 0x45000000)
+	{
+	  key |= (val & 0x00010000);		/* BC1f/t */
+	  slot = SLOT_COP1 + (rs << 6) + ((val >> 16) & 0x1);
+	}
+      else
+	{
+	  key |= (val & 0x3f);
+	  slot = SLOT_COP1 + (rs << 6) + (val & 0x3f);
+	}
+      break;
+
+    case 0x12:					/* COPz */
+      key |= (val & 0x03e00000);
+      slot = SLOT_COP2 + rs;
+      break;
+
+    case 0x13:					/* COP1X */
+      key |= (val & 0x03e00000);
+      slot = SLOT_COP1X + rs;
+      break;
+
+    default:
+      slot = (val >> 26) & 0x3f;
+      break;
+    }
+
+  *key_out = key;
+  return (slot);
+}
+
+
+/* BY_OPCODE[OP - MIN_OPCODE] is the index in NAME_TBL of internal
+   opcode OP, or -1.  BY_ENCODING[decode_slot (VAL)] is the index in
+   NAME_TBL of the instruction whose binary encoding is VAL, or -1. */
+
+typedef struct
+{
+  short by_opcode [MAX_OPCODE - MIN_OPCODE + 1];
+  short by_encoding [DECODE_SLOTS];
+} inst_index;
+
+
+static constexpr inst_index
+build_inst_index ()
+{
+  inst_index t {};
+  int i = 0;
+
+  for (i = 0; i < MAX_OPCODE - MIN_OPCODE + 1; i++)
+    t.by_opcode[i] = -1;
+  for (i = 0; i < DECODE_SLOTS; i++)
+    t.by_encoding[i] = -1;
+
+  for (i = 0; i < N_OPS; i++)
+    {
+      int32 a_opcode = op_encodings[i].a_opcode;
+      int32 key = 0;
+      int slot = 0;
+
+      t.by_opcode[op_encodings[i].opcode - MIN_OPCODE] = (short) i;
+
+      /* Pseudo-instructions (a_opcode -1) and encodings with bits outside
+	 the fields that identify an instruction can never be decoded. */
+      slot = decode_slot (a_opcode, &key);
+      if (a_opcode == -1 || key != a_opcode)
+	continue;
+
+      /* op.h gives a few MIPS32 Rev 2 instructions the same encoding as
+	 another instruction.  Keep the one with the higher type, which is
+	 the one the sorted-table search used to find. */
+      if (t.by_encoding[slot] == -1
+	  || op_encodings[t.by_encoding[slot]].type < op_encodings[i].type)
+	t.by_encoding[slot] = (short) i;
+    }
+  return (t);
+}
+
+static constexpr inst_index inst_tables = build_inst_index ();
+
+
+/* Reset the instruction tables' state. */
+
+void
+initialize_inst_tables ()
+{
+	/* The old breakpoint instruction went with the arena. */
+	break_inst = NULL;
+}
+
+
+/* Return the NAME_TBL entry for internal opcode OPCODE, or NULL. */
+
+static name_val_val *
+opcode_entry (int opcode)
+{
+  int i;
+
+  if (opcode < MIN_OPCODE || opcode > MAX_OPCODE)
+    return (NULL);
+  i = inst_tables.by_opcode[opcode - MIN_OPCODE];
+  return (i < 0 ? NULL : &name_tbl[i]);
 }
 
 
@@ -694,11 +862,11 @@ format_an_inst (str_stream *ss, instruction *inst, mem_addr addr)
 
   if (addr != 0 && inst_is_breakpoint (addr))
     {
-      delete_breakpoint (addr);
+      /* Show the instruction under the breakpoint, without disturbing the
+	 breakpoint's condition and counts. */
       ss_printf (ss, "*");
-      format_an_inst (ss, read_mem_inst (addr), addr);
-      add_breakpoint (addr);
-      return;
+      line_start = ss_length (ss);
+      inst = breakpoint_instruction (addr);
     }
 
   ss_printf (ss, "[0x%08x]\t", addr);
@@ -708,9 +876,7 @@ format_an_inst (str_stream *ss, instruction *inst, mem_addr addr)
       return;
     }
 
-  entry = map_int_to_name_val_val (name_tbl,
-				   sizeof (name_tbl) / sizeof (name_val_val),
-				   OPCODE (inst));
+  entry = opcode_entry (OPCODE (inst));
   if (entry == NULL)
     {
       ss_printf (ss, "<unknown instruction %d>\n", OPCODE (inst));
@@ -848,7 +1014,8 @@ format_an_inst (str_stream *ss, instruction *inst, mem_addr addr)
 	}
 
       ss_printf (ss, "; ");
-      ss_printf (ss, "%s", SOURCE (inst));
+      ss_printf (ss, "%d: %.*s", SOURCE_LINE_NO (inst), SOURCE_LENGTH (inst),
+		 SOURCE (inst));
     }
 
   ss_printf (ss, "\n");
@@ -1008,6 +1175,64 @@ opcode_is_load_store (int opcode)
 }
 
 
+/* Return true if SPIM OPCODE (e.g. Y_...) reads memory. */
+
+bool
+opcode_is_load (int opcode)
+{
+  switch (opcode)
+    {
+    case Y_LB_OP:
+    case Y_LBU_OP:
+    case Y_LH_OP:
+    case Y_LHU_OP:
+    case Y_LL_OP:
+    case Y_LDC1_OP:
+    case Y_LDC2_OP:
+    case Y_LDXC1_OP:
+    case Y_LUXC1_OP:
+    case Y_LW_OP:
+    case Y_LWC1_OP:
+    case Y_LWC2_OP:
+    case Y_LWL_OP:
+    case Y_LWR_OP:
+    case Y_LWXC1_OP:
+      return true;
+
+    default:
+      return false;
+    }
+}
+
+
+/* Return true if SPIM OPCODE (e.g. Y_...) writes memory. */
+
+bool
+opcode_is_store (int opcode)
+{
+  switch (opcode)
+    {
+    case Y_SB_OP:
+    case Y_SC_OP:
+    case Y_SH_OP:
+    case Y_SDC1_OP:
+    case Y_SDC2_OP:
+    case Y_SDXC1_OP:
+    case Y_SUXC1_OP:
+    case Y_SW_OP:
+    case Y_SWC1_OP:
+    case Y_SWC2_OP:
+    case Y_SWL_OP:
+    case Y_SWR_OP:
+    case Y_SWXC1_OP:
+      return true;
+
+    default:
+      return false;
+    }
+}
+
+
 /* Return true if a breakpoint is set at ADDR. */
 
 bool
@@ -1053,7 +1278,7 @@ set_breakpoint (mem_addr addr)
 imm_expr *
 make_imm_expr (int offs, char *sym, bool is_pc_relative)
 {
-  imm_expr *expr = (imm_expr *) xmalloc (sizeof (imm_expr));
+  imm_expr *expr = (imm_expr *) arena_alloc (sizeof (imm_expr));
 
   expr->offset = offs;
   expr->bits = 0;
@@ -1071,7 +1296,7 @@ make_imm_expr (int offs, char *sym, bool is_pc_relative)
 imm_expr *
 copy_imm_expr (imm_expr *old_expr)
 {
-  imm_expr *expr = (imm_expr *) xmalloc (sizeof (imm_expr));
+  imm_expr *expr = (imm_expr *) arena_alloc (sizeof (imm_expr));
 
   *expr = *old_expr;
   /*memcpy ((void*)expr, (void*)old_expr, sizeof (imm_expr));*/
@@ -1199,7 +1424,7 @@ is_zero_imm (imm_expr *expr)
 addr_expr *
 make_addr_expr (int offs, char *sym, int reg_no)
 {
-  addr_expr *expr = (addr_expr *) xmalloc (sizeof (addr_expr));
+  addr_expr *expr = (addr_expr *) arena_alloc (sizeof (addr_expr));
   label *lab;
 
   if (reg_no == 0 && sym != NULL && (lab = lookup_label (sym))->gp_flag)
@@ -1210,7 +1435,7 @@ make_addr_expr (int offs, char *sym, int reg_no)
   else
     {
       expr->reg_no = (unsigned char)reg_no;
-      expr->imm = make_imm_expr (offs, (sym ? str_copy (sym) : sym), false);
+      expr->imm = make_imm_expr (offs, sym, false);
     }
   return (expr);
 }
@@ -1235,32 +1460,6 @@ addr_expr_reg (addr_expr *expr)
    instruction. */
 
 
-/* Maintain a table mapping from internal opcode (i_opcode) to actual
-   opcode (a_opcode).  Table must be sorted before first use since its
-   entries are alphabetical on name, not ordered by opcode. */
-
-
-/* Map from internal opcode -> real opcode */
-
-static name_val_val i_opcode_tbl [] = {
-#undef OP
-#define OP(NAME, I_OPCODE, TYPE, A_OPCODE) {NAME, I_OPCODE, (int)A_OPCODE},
-#include "op.h"
-};
-
-
-/* Sort the opcode table on their key (the interal opcode value). */
-
-static void
-sort_i_opcode_table ()
-{
-  qsort (i_opcode_tbl,
-	 sizeof (i_opcode_tbl) / sizeof (name_val_val),
-	 sizeof (name_val_val),
-	 (QSORT_FUNC) compare_pair_value);
-}
-
-
 #define REGS(R,O) (((R) & 0x1f) << O)
 
 
@@ -1273,16 +1472,11 @@ inst_encode (instruction *inst)
   if (inst == NULL)
     return (0);
 
-  entry = map_int_to_name_val_val (i_opcode_tbl,
-				sizeof (i_opcode_tbl) / sizeof (name_val_val),
-				OPCODE (inst));
+  entry = opcode_entry (OPCODE (inst));
   if (entry == NULL)
     return 0;
 
-  a_opcode = entry->value2;
-  entry = map_int_to_name_val_val (name_tbl,
-				sizeof (name_tbl) / sizeof (name_val_val),
-				OPCODE (inst));
+  a_opcode = op_encodings[entry - name_tbl].a_opcode;
 
   switch (entry->value2)
     {
@@ -1416,71 +1610,22 @@ inst_encode (instruction *inst)
 }
 
 
-/* Maintain a table mapping from actual opcode to interal opcode.
-   Table must be sorted before first use since its entries are
-   alphabetical on name, not ordered by opcode. */
-
-
-/* Map from internal opcode -> real opcode */
-
-static name_val_val a_opcode_tbl [] = {
-#undef OP
-#define OP(NAME, I_OPCODE, TYPE, A_OPCODE) {NAME, (int)A_OPCODE, (int)I_OPCODE},
-#include "op.h"
-};
-
-
-/* Sort the opcode table on their key (the interal opcode value). */
-
-static void
-sort_a_opcode_table ()
-{
-  qsort (a_opcode_tbl,
-	 sizeof (a_opcode_tbl) / sizeof (name_val_val),
-	 sizeof (name_val_val),
-	 (QSORT_FUNC) compare_pair_value);
-}
-
-
-
 instruction *
 inst_decode (int32 val)
 {
-  int32 a_opcode = val & 0xfc000000;
   name_val_val *entry;
   int32 i_opcode;
+  int32 key;
+  int i;
 
-  /* Field classes: (opcode is continued in other part of instruction): */
-  if (a_opcode == 0 || a_opcode == 0x70000000) /* SPECIAL or SPECIAL2 */
-    a_opcode |= (val & 0x3f);
-  else if (a_opcode == 0x04000000)		/* REGIMM */
-    a_opcode |= (val & 0x001f0000);
-  else if (a_opcode == 0x40000000)		/* COP0 */
-    a_opcode |= (val & 0x03e00000) | (val & 0x1f);
-  else if (a_opcode == 0x44000000)		/* COP1 */
-    {
-      a_opcode |= (val & 0x03e00000);
-      if ((val & 0xff000000) == 0x45000000)
-	a_opcode |= (val & 0x00010000);		/* BC1f/t */
-      else
-	a_opcode |= (val & 0x3f);
-    }
-  else if (a_opcode == 0x48000000		/* COPz */
-	   || a_opcode == 0x4c000000)
-    a_opcode |= (val & 0x03e00000);
-
-
-  entry = map_int_to_name_val_val (a_opcode_tbl,
-				sizeof (a_opcode_tbl) / sizeof (name_val_val),
-				a_opcode);
-  if (entry == NULL)
+  i = inst_tables.by_encoding[decode_slot (val, &key)];
+  if (i < 0)
     return (mk_r_inst (val, 0, 0, 0, 0, 0)); /* Invalid inst */
 
-  i_opcode = entry->value2;
+  entry = &name_tbl[i];
+  i_opcode = entry->value1;
 
-  switch (map_int_to_name_val_val (name_tbl,
-				sizeof (name_tbl) / sizeof (name_val_val),
-				i_opcode)->value2)
+  switch (entry->value2)
     {
     case BC_TYPE_INST:
       return (mk_i_inst (val, i_opcode, BIN_RS(val), BIN_RT(val),
@@ -1570,7 +1715,7 @@ inst_decode (int32 val)
 static instruction *
 mk_r_inst (int32 val, int opcode, int rs, int rt, int rd, int shamt)
 {
-  instruction *inst = (instruction *) zmalloc (sizeof (instruction));
+  instruction *inst = (instruction *) arena_alloc (sizeof (instruction));
 
   SET_OPCODE (inst, opcode);
   SET_RS (inst, rs);
@@ -1585,7 +1730,7 @@ mk_r_inst (int32 val, int opcode, int rs, int rt, int rd, int shamt)
 static instruction *
 mk_co_r_inst (int32 val, int opcode, int fs, int ft, int fd)
 {
-  instruction *inst = (instruction *) zmalloc (sizeof (instruction));
+  instruction *inst = (instruction *) arena_alloc (sizeof (instruction));
 
   SET_OPCODE (inst, opcode);
   SET_FS (inst, fs);
@@ -1599,7 +1744,7 @@ mk_co_r_inst (int32 val, int opcode, int fs, int ft, int fd)
 static instruction *
 mk_i_inst (int32 val, int opcode, int rs, int rt, int offset)
 {
-  instruction *inst = (instruction *) zmalloc (sizeof (instruction));
+  instruction *inst = (instruction *) arena_alloc (sizeof (instruction));
 
   SET_OPCODE (inst, opcode);
   SET_RS (inst, rs);
@@ -1613,7 +1758,7 @@ mk_i_inst (int32 val, int opcode, int rs, int rt, int offset)
 static instruction *
 mk_j_inst (int32 val, int opcode, int target)
 {
-  instruction *inst = (instruction *) zmalloc (sizeof (instruction));
+  instruction *inst = (instruction *) arena_alloc (sizeof (instruction));
 
   SET_OPCODE (inst, opcode);
   SET_TARGET (inst, target);
@@ -61,6 +61,7 @@ typedef struct addrexpr
 typedef struct inst_s
 {
   short opcode;
+  unsigned short source_length;
 
   union
     {
@@ -87,8 +88,9 @@ typedef struct inst_s
     } r_t;
 
   int32 encoding;
+  int32 source_line_no;
   imm_expr *expr;
-  char *source_line;
+  char *source_line;		/* Not null terminated */
 } instruction;
 
 
@@ -152,7 +154,12 @@ typedef struct inst_s
 #define SET_EXPR(INST, VAL)	(INST)->expr = (imm_expr*)(VAL)
 
 #define SOURCE(INST)		(INST)->source_line
-#define SET_SOURCE(INST, VAL)	(INST)->source_line = (char *)(VAL)
+#define SOURCE_LENGTH(INST)	(INST)->source_length
+#define SOURCE_LINE_NO(INST)	(INST)->source_line_no
+#define SET_SOURCE(INST, VAL, LEN, LINE_NO)	\
+  ((INST)->source_line = (char *)(VAL),		\
+   (INST)->source_length = (unsigned short)(LEN), \
+   (INST)->source_line_no = (int32)(LINE_NO))
 
 
 #define COND_UN		0x1
@@ -261,6 +268,8 @@ bool opcode_is_nullified_branch (int opcode);
 bool opcode_is_true_branch (int opcode);
 bool opcode_is_jump (int opcode);
 bool opcode_is_load_store (int opcode);
+bool opcode_is_load (int opcode);
+bool opcode_is_store (int opcode);
 void print_inst (mem_addr addr);
 char* inst_to_string (mem_addr addr);
 void r_co_type_inst (int opcode, int fd, int fs, int ft);
@@ -31,6 +31,13 @@
 */
 
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 #include "spim.h"
 #include "string-stream.h"
 #include "spim-utils.h"
@@ -76,15 +83,38 @@ static mem_word bad_mem_read (mem_addr addr, int mask);
 static void bad_mem_write (mem_addr addr, mem_word value, int mask);
 static instruction *bad_text_read (mem_addr addr);
 static void bad_text_write (mem_addr addr, instruction *inst);
-static void free_instructions (instruction **inst, int n);
 static mem_word read_memory_mapped_IO (mem_addr addr);
 static void write_memory_mapped_IO (mem_addr addr, mem_word value);
+static struct mapped_region *find_mapped_region (mem_addr addr);
+static void unmap_file_regions ();
 
 
 /* Local variables: */
 
 static int32 data_size_limit, stack_size_limit, k_data_size_limit;
 
+
+/* Files mapped into the address space by the mmap syscall.  Each occupies
+   a page-aligned region between MAPPED_BOT and MAPPED_TOP, with an
+   unmapped page after it.  The in-line checks in read_mem_* and
+   set_mem_* do not look at these regions; accesses to them go through
+   the bad_mem_* slow paths. */
+
+typedef struct mapped_region
+{
+  mem_addr bot;			/* First guest address */
+  mem_addr top;			/* Exclusive */
+  BYTE_TYPE *addr;		/* Host address of BOT */
+  size_t size;			/* Host mapping length */
+  bool writable;		/* => private copy, else read only */
+  struct mapped_region *next;
+} mapped_region;
+
+static mapped_region *mapped_regions = NULL;
+
+static mem_addr lowest_mapped_addr;	/* Data segment must stay below */
+static mem_addr next_mapped_addr = MAPPED_BOT;
+
 
 
 /* Memory is allocated in five chunks:
@@ -126,13 +156,12 @@ make_memory (int text_size, int data_size, int data_limit,
     data_size = 65536;
   data_size = ROUND_UP(data_size, BYTES_PER_WORD); /* Keep word aligned */
 
+  /* The old instructions were allocated from the arena, which
+     initialize_world releases in one step. */
   if (text_seg == NULL)
     text_seg = (instruction **) xmalloc (BYTES_TO_INST(text_size));
   else
-    {
-      free_instructions (text_seg, (text_top - TEXT_BOT) / BYTES_PER_WORD);
-      text_seg = (instruction **) realloc (text_seg, BYTES_TO_INST(text_size));
-    }
+    text_seg = (instruction **) realloc (text_seg, BYTES_TO_INST(text_size));
   memclr (text_seg, BYTES_TO_INST(text_size));
   text_top = TEXT_BOT + text_size;
 
@@ -161,12 +190,8 @@ make_memory (int text_size, int data_size, int data_limit,
   if (k_text_seg == NULL)
     k_text_seg = (instruction **) xmalloc (BYTES_TO_INST(k_text_size));
   else
-    {
-      free_instructions (k_text_seg,
-			 (k_text_top - K_TEXT_BOT) / BYTES_PER_WORD);
-      k_text_seg = (instruction **) realloc(k_text_seg,
-					    BYTES_TO_INST(k_text_size));
-    }
+    k_text_seg = (instruction **) realloc(k_text_seg,
+					  BYTES_TO_INST(k_text_size));
   memclr (k_text_seg, BYTES_TO_INST(k_text_size));
   k_text_top = K_TEXT_BOT + k_text_size;
 
@@ -181,19 +206,32 @@ make_memory (int text_size, int data_size, int data_limit,
   k_data_top = K_DATA_BOT + k_data_size;
   k_data_size_limit = k_data_limit;
 
+  unmap_file_regions ();
+
   text_modified = true;
   data_modified = true;
 }
 
 
-/* Free the storage used by the old instructions in memory. */
+/* Expand the user text segment by adding N bytes.  It can grow up to the
+   bottom of the data segment. */
 
-static void
-free_instructions (instruction **inst, int n)
+void
+expand_text (int addl_bytes)
 {
-  for ( ; n > 0; n --, inst ++)
-    if (*inst)
-      free_inst (*inst);
+  int delta = ROUND_UP(addl_bytes, BYTES_PER_WORD); /* Keep word aligned */
+  int old_size = text_top - TEXT_BOT;
+  int new_size = old_size + delta;
+
+  if ((addl_bytes < 0) || (TEXT_BOT + new_size > DATA_BOT))
+    run_error ("Can't expand text segment by %d bytes to %d bytes\n",
+	       addl_bytes, new_size);
+
+  text_seg = (instruction **) realloc (text_seg, BYTES_TO_INST(new_size));
+  if (text_seg == NULL)
+    fatal_error ("realloc failed in expand_text\n");
+  memclr (&text_seg[old_size / BYTES_PER_WORD], BYTES_TO_INST(delta));
+  text_top += delta;
 }
 
 
@@ -207,7 +245,8 @@ expand_data (int addl_bytes)
   int new_size = old_size + delta;
   BYTE_TYPE *p;
 
-  if ((addl_bytes < 0) || (new_size > data_size_limit))
+  if ((addl_bytes < 0) || (new_size > data_size_limit)
+      || (mapped_regions != NULL && DATA_BOT + new_size > lowest_mapped_addr))
     {
       error ("Can't expand data segment by %d bytes to %d bytes\n",
 	     addl_bytes, new_size);
@@ -297,6 +336,8 @@ expand_k_data (int addl_bytes)
 void*
 mem_reference(mem_addr addr)
 {
+  mapped_region *region;
+
   if ((addr >= TEXT_BOT) && (addr < text_top))
     return addr - TEXT_BOT + (char*) text_seg;
   else if ((addr >= DATA_BOT) && (addr < data_top))
@@ -307,6 +348,8 @@ mem_reference(mem_addr addr)
     return addr - K_TEXT_BOT + (char*) k_text_seg;
   else if ((addr >= K_DATA_BOT) && (addr < k_data_top))
     return addr - K_DATA_BOT + (char*) k_data_seg;
+  else if ((region = find_mapped_region (addr)) != NULL)
+    return addr - region->bot + region->addr;
   else
     {
       run_error ("Memory address out of bounds\n");
@@ -315,6 +358,47 @@ mem_reference(mem_addr addr)
 }
 
 
+/* Return a pointer to the byte at ADDR in the user data, stack, or kernel
+   data segment, or a mapped file, and set *LENGTH to the number of bytes
+   from ADDR to the top of that segment.  Return NULL if ADDR is in none of
+   them, or if STORE and ADDR is in a read-only mapping.  Unlike
+   mem_reference, this does not report an error, so callers can raise
+   the exception that fits. */
+
+BYTE_TYPE *
+mem_data_reference (mem_addr addr, mem_addr *length, bool store)
+{
+  mapped_region *region;
+
+  if ((addr >= DATA_BOT) && (addr < data_top))
+    {
+      *length = data_top - addr;
+      return data_seg_b + (addr - DATA_BOT);
+    }
+  else if ((addr >= stack_bot) && (addr < STACK_TOP))
+    {
+      *length = STACK_TOP - addr;
+      return stack_seg_b + (addr - stack_bot);
+    }
+  else if ((addr >= K_DATA_BOT) && (addr < k_data_top))
+    {
+      *length = k_data_top - addr;
+      return k_data_seg_b + (addr - K_DATA_BOT);
+    }
+  else if ((region = find_mapped_region (addr)) != NULL
+	   && (region->writable || !store))
+    {
+      *length = region->top - addr;
+      return region->addr + (addr - region->bot);
+    }
+  else
+    {
+      *length = 0;
+      return NULL;
+    }
+}
+
+
 instruction*
 read_mem_inst(mem_addr addr)
 {
@@ -449,6 +533,7 @@ static mem_word
 bad_mem_read (mem_addr addr, int mask)
 {
   mem_word tmp;
+  mapped_region *region;
 
   if ((addr & mask) != 0)
     RAISE_EXCEPTION (ExcCode_AdEL, CP0_BadVAddr = addr)
@@ -485,6 +570,17 @@ bad_mem_read (mem_addr addr, int mask)
       default:
 	run_error ("Bad mask (0x%x) in bad_mem_read\n", mask);
       }
+  else if ((region = find_mapped_region (addr)) != NULL)
+    {
+      BYTE_TYPE *p = region->addr + (addr - region->bot);
+
+      if (mask == 0)
+	return (*p);
+      else if (mask == 1)
+	return (*(short *) p);
+      else
+	return (*(mem_word *) p);
+    }
   else if (addr > data_top
 	   && addr < stack_bot
 	   /* If more than 16 MB below stack, probably is bad data ref */
@@ -507,6 +603,7 @@ static void
 bad_mem_write (mem_addr addr, mem_word value, int mask)
 {
   mem_word tmp;
+  mapped_region *region;
 
   if ((addr & mask) != 0)
     /* Unaligned address fault */
@@ -554,6 +651,23 @@ bad_mem_write (mem_addr addr, mem_word value, int mask)
 
     text_modified = true;
   }
+  else if ((region = find_mapped_region (addr)) != NULL)
+  {
+    BYTE_TYPE *p = region->addr + (addr - region->bot);
+
+    if (!region->writable)
+      RAISE_EXCEPTION (ExcCode_DBE, CP0_BadVAddr = addr)
+    else
+    {
+      if (mask == 0)
+	*p = (BYTE_TYPE) value;
+      else if (mask == 1)
+	*(short *) p = (short) value;
+      else
+	*(mem_word *) p = value;
+      data_modified = true;
+    }
+  }
   else if (addr > data_top
 	   && addr < stack_bot
 	   /* If more than 16 MB below stack, probably is bad data ref */
@@ -740,6 +854,101 @@ read_memory_mapped_IO (mem_addr addr)
 
 
 
+/* Map the file named FILE_NAME into a new region of the address space,
+   read only or, if WRITABLE, as a private copy whose changes are never
+   written back.  Return the region's first address and set *LENGTH to
+   the file's length, or return 0 if the file cannot be mapped or does
+   not fit below MAPPED_TOP. */
+
+mem_addr
+map_file (char *file_name, bool writable, mem_addr *length)
+{
+#ifdef _WIN32
+  return (0);
+#else
+  mapped_region *region;
+  struct stat st;
+  mem_addr bot, top;
+  void *addr;
+  int fd;
+
+  fd = open (file_name, O_RDONLY);
+  if (fd < 0)
+    return (0);
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode) || st.st_size == 0
+      || (unsigned long long) st.st_size > MAPPED_TOP - MAPPED_BOT)
+    {
+      close (fd);
+      return (0);
+    }
+
+  /* The data segment may already have grown past MAPPED_BOT. */
+  bot = ROUND_UP (MAX (next_mapped_addr, data_top), MAPPED_PAGE_SIZE);
+  top = bot + ROUND_UP ((mem_addr) st.st_size, MAPPED_PAGE_SIZE);
+  if (top > MAPPED_TOP || top < bot)
+    {
+      close (fd);
+      return (0);
+    }
+
+  addr = mmap (NULL, (size_t) st.st_size,
+	       writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE,
+	       fd, 0);
+  close (fd);
+  if (addr == MAP_FAILED)
+    return (0);
+
+  region = (mapped_region *) xmalloc (sizeof (mapped_region));
+  region->bot = bot;
+  region->top = top;
+  region->addr = (BYTE_TYPE *) addr;
+  region->size = (size_t) st.st_size;
+  region->writable = writable;
+  if (mapped_regions == NULL)
+    lowest_mapped_addr = bot;
+  region->next = mapped_regions;
+  mapped_regions = region;
+
+  /* Leave a page unmapped, so running off the end faults. */
+  next_mapped_addr = top + MAPPED_PAGE_SIZE;
+  *length = (mem_addr) st.st_size;
+  return (bot);
+#endif
+}
+
+
+static mapped_region *
+find_mapped_region (mem_addr addr)
+{
+  mapped_region *region;
+
+  for (region = mapped_regions; region != NULL; region = region->next)
+    if (region->bot <= addr && addr < region->top)
+      return (region);
+  return (NULL);
+}
+
+
+/* Unmap every mapped file.  Called when memory is remade. */
+
+static void
+unmap_file_regions ()
+{
+  while (mapped_regions != NULL)
+    {
+      mapped_region *region = mapped_regions;
+
+#ifndef _WIN32
+      munmap (region->addr, region->size);
+#endif
+      mapped_regions = region->next;
+      free (region);
+    }
+  next_mapped_addr = MAPPED_BOT;
+}
+
+
+
 /* Misc. routines */
 
 void
@@ -113,6 +113,15 @@ extern BYTE_TYPE *k_data_seg_b;
 extern mem_addr k_data_top;
 
 
+/* Files mapped by the mmap syscall are placed between the data segment
+   and the stack. */
+
+#define MAPPED_BOT		((mem_addr) 0x40000000)
+#define MAPPED_TOP		((mem_addr) 0x70000000)
+
+#define MAPPED_PAGE_SIZE	4096
+
+
 /* Memory-mapped IO area: */
 #define MM_IO_BOT		((mem_addr) 0xffff0000)
 #define MM_IO_TOP		((mem_addr) 0xffffffff)
@@ -146,9 +155,12 @@ void check_memory_mapped_IO ();
 void expand_data (int addl_bytes);
 void expand_k_data (int addl_bytes);
 void expand_stack (int addl_bytes);
+void expand_text (int addl_bytes);
 void make_memory (int text_size, int data_size, int data_limit,
 		  int stack_size, int stack_limit, int k_text_size,
 		  int k_data_size, int k_data_limit);
+mem_addr map_file (char *file_name, bool writable, mem_addr *length);
+BYTE_TYPE *mem_data_reference (mem_addr addr, mem_addr *length, bool store);
 void* mem_reference(mem_addr addr);
 void print_mem (mem_addr addr);
 instruction* read_mem_inst(mem_addr addr);
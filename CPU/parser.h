@@ -48,3 +48,9 @@ extern bool data_dir;		/* => item in data segment */
 extern bool text_dir;		/* => item in text segment */
 
 extern bool parse_error_occurred; /* => parse resulted in error */
+
+extern bool parse_warning_occurred; /* => error or warning in current file */
+
+extern bool text_address_given;	/* => .text or .ktext set the text pc */
+
+extern bool data_address_given;	/* => a data directive set the data pc */
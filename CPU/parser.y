@@ -472,6 +472,12 @@ bool text_dir;                  /* => item in text segment */
 
 bool parse_error_occurred;      /* => parse resulted in error */
 
+bool parse_warning_occurred;    /* => error or warning in current file */
+
+bool text_address_given;        /* => .text or .ktext set the text pc */
+
+bool data_address_given;        /* => a data directive set the data pc */
+
 
 /* Local functions: */
 
@@ -523,15 +529,14 @@ LBL_CMD:	OPT_LBL CMD
 OPT_LBL: ID ':' {
 		  /* Call outside of cons_label, since an error sets that variable to NULL. */
 		  label* l = record_label ((char*)$1.p,
-					   text_dir ? current_text_pc () : current_data_pc (),
-					   0);
+					   text_dir ? current_text_pc () : current_data_pc ());
 		  this_line_labels = cons_label (l, this_line_labels);
 		  free ((char*)$1.p);
 		}
 
 	|	ID '=' EXPR
 		{
-		  label *l = record_label ((char*)$1.p, (mem_addr)$3.i, 1);
+		  label *l = record_label ((char*)$1.p, (mem_addr)$3.i);
 		  free ((char*)$1.p);
 
 		  l->const_flag = 1;
@@ -582,8 +587,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 				      addr_expr_reg ((addr_expr *)$3.p),
 				      incr_expr_offset (addr_expr_imm ((addr_expr *)$3.p),
 							4));
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 	|	LOADC_OPS	COP_REG	ADDRESS
@@ -592,8 +597,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 			       $2.i,
 			       addr_expr_reg ((addr_expr *)$3.p),
 			       addr_expr_imm ((addr_expr *)$3.p));
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 	|	LOADFP_OPS	F_SRC1	ADDRESS
@@ -602,8 +607,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 			       $2.i,
 			       addr_expr_reg ((addr_expr *)$3.p),
 			       addr_expr_imm ((addr_expr *)$3.p));
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 	|	LOADI_OPS	DEST	UIMM16
@@ -621,8 +626,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		  else
 		    i_type_inst (Y_ORI_OP, $2.i, 0,
 				 addr_expr_imm ((addr_expr *)$3.p));
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 
@@ -672,8 +677,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 			       addr_expr_reg ((addr_expr *)$3.p),
 			       addr_expr_imm ((addr_expr *)$3.p));
 #endif
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 
@@ -700,8 +705,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 #endif
 		  r_sh_type_inst (Y_SLL_OP, $2.i, $2.i, 8);
 		  r_type_inst (Y_OR_OP, $2.i, $2.i, 1);
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 
@@ -722,8 +727,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 				      addr_expr_reg ((addr_expr *)$3.p),
 				      incr_expr_offset (addr_expr_imm ((addr_expr *)$3.p),
 							4));
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 
@@ -733,8 +738,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 			       $2.i,
 			       addr_expr_reg ((addr_expr *)$3.p),
 			       addr_expr_imm ((addr_expr *)$3.p));
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 
@@ -757,8 +762,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 			       addr_expr_reg ((addr_expr *)$3.p),
 			       addr_expr_imm ((addr_expr *)$3.p));
 #endif
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 
@@ -782,8 +787,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		  r_sh_type_inst (Y_SLL_OP, $2.i, $2.i, 8);
 		  r_type_inst (Y_OR_OP, $2.i, $2.i, 1);
 
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 
@@ -793,8 +798,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 			       $2.i,
 			       addr_expr_reg ((addr_expr *)$3.p),
 			       addr_expr_imm ((addr_expr *)$3.p));
-		  free (((addr_expr *)$3.p)->imm);
-		  free ((addr_expr *)$3.p);
+		  arena_free (((addr_expr *)$3.p)->imm, sizeof (imm_expr));
+		  arena_free ($3.p, sizeof (addr_expr));
 		}
 
 
@@ -1018,7 +1023,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 				   $3.i,
 				   (is_zero_imm ((imm_expr *)$4.p) ? 0 : 1));
 		    }
-		  free ((imm_expr *)$4.p);
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 	|	BINARY_OPS	DEST	IMM32
@@ -1036,7 +1041,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 				   $2.i,
 				   (is_zero_imm ((imm_expr *)$3.p) ? 0 : 1));
 		    }
-		  free ((imm_expr *)$3.p);
+		  arena_free ($3.p, sizeof (imm_expr));
 		}
 
 
@@ -1064,7 +1069,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 				 $2.i,
 				 $3.i,
 				 make_imm_expr (-val, NULL, false));
-		  free ((imm_expr *)$4.p);
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 	|	SUB_OPS		DEST	IMM32
@@ -1080,7 +1085,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 				 $2.i,
 				 $2.i,
 				 make_imm_expr (-val, NULL, false));
-		  free ((imm_expr *)$3.p);
+		  arena_free ($3.p, sizeof (imm_expr));
 		}
 
 
@@ -1177,7 +1182,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		  r_sh_type_inst (Y_SLL_OP, 1, $3.i, -dist);
 		  r_sh_type_inst (Y_SRL_OP, $2.i, $3.i, dist);
 		  r_type_inst (Y_OR_OP, $2.i, $2.i, 1);
-		  free ((imm_expr *)$4.p);
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 
@@ -1189,7 +1194,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		  r_sh_type_inst (Y_SRL_OP, 1, $3.i, -dist);
 		  r_sh_type_inst (Y_SLL_OP, $2.i, $3.i, dist);
 		  r_type_inst (Y_OR_OP, $2.i, $2.i, 1);
-		  free ((imm_expr *)$4.p);
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 
@@ -1211,7 +1216,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		    i_type_inst (Y_ORI_OP, 1, 0, (imm_expr *)$4.p);
 		  set_le_inst ($1.i, $2.i, $3.i,
 			       (is_zero_imm ((imm_expr *)$4.p) ? 0 : 1));
-		  free ((imm_expr *)$4.p);
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 
@@ -1227,7 +1232,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		    i_type_inst (Y_ORI_OP, 1, 0, (imm_expr *)$4.p);
 		  set_gt_inst ($1.i, $2.i, $3.i,
 			       (is_zero_imm ((imm_expr *)$4.p) ? 0 : 1));
-		  free ((imm_expr *)$4.p);
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 
@@ -1244,7 +1249,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		    i_type_inst (Y_ORI_OP, 1, 0, (imm_expr *)$4.p);
 		  set_ge_inst ($1.i, $2.i, $3.i,
 			       (is_zero_imm ((imm_expr *)$4.p) ? 0 : 1));
-		  free ((imm_expr *)$4.p);
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 
@@ -1260,7 +1265,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		    i_type_inst (Y_ORI_OP, 1, 0, (imm_expr *)$4.p);
 		  set_eq_inst ($1.i, $2.i, $3.i,
 			       (is_zero_imm ((imm_expr *)$4.p) ? 0 : 1));
-		  free ((imm_expr *)$4.p);
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 
@@ -1324,8 +1329,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 				       (imm_expr *)$4.p);
 			}
 		    }
-		  free ((imm_expr *)$3.p);
-		  free ((imm_expr *)$4.p);
+		  arena_free ($3.p, sizeof (imm_expr));
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 
@@ -1354,8 +1359,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		      r_type_inst (Y_SLTU_OP, 1, $2.i, 1);
 		      i_type_inst (Y_BEQ_OP, 0, 1, (imm_expr *)$4.p);
 		    }
-		  free ((imm_expr *)$3.p);
-		  free ((imm_expr *)$4.p);
+		  arena_free ($3.p, sizeof (imm_expr));
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 
@@ -1371,7 +1376,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		  i_type_inst ($1.i == Y_BGE_POP ? Y_SLTI_OP : Y_SLTIU_OP,
 			       1, $2.i, (imm_expr *)$3.p); /* Use $at */
 		  i_type_inst_free (Y_BEQ_OP, 0, 1, (imm_expr *)$4.p);
-		  free ((imm_expr *)$3.p);
+		  arena_free ($3.p, sizeof (imm_expr));
 		}
 
 
@@ -1387,7 +1392,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		  i_type_inst ($1.i == Y_BLT_POP ? Y_SLTI_OP : Y_SLTIU_OP,
 			       1, $2.i, (imm_expr *)$3.p); /* Use $at */
 		  i_type_inst_free (Y_BNE_OP, 0, 1, (imm_expr *)$4.p);
-		  free ((imm_expr *)$3.p);
+		  arena_free ($3.p, sizeof (imm_expr));
 		}
 
 
@@ -1416,8 +1421,8 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		      r_type_inst (Y_SLTU_OP, 1, $2.i, 1);
 		      i_type_inst (Y_BNE_OP, 0, 1, (imm_expr *)$4.p);
 		    }
-		  free ((imm_expr *)$3.p);
-		  free ((imm_expr *)$4.p);
+		  arena_free ($3.p, sizeof (imm_expr));
+		  arena_free ($4.p, sizeof (imm_expr));
 		}
 
 
@@ -1427,7 +1432,7 @@ ASM_CODE:	LOAD_OPS	DEST	ADDRESS
 		    j_type_inst (Y_J_OP, (imm_expr *)$2.p);
 		  else if (($1.i == Y_JAL_OP) || ($1.i == Y_JALR_OP))
 		    j_type_inst (Y_JAL_OP, (imm_expr *)$2.p);
-		  free ((imm_expr *)$2.p);
+		  arena_free ($2.p, sizeof (imm_expr));
 		}
 
 	|	J_OPS		SRC1
@@ -2140,7 +2145,7 @@ ASM_DIRECTIVE:	Y_ALIAS_DIR	Y_REG	Y_REG
 		  align_data (2);
 		  if (lookup_label ((char*)$2.p)->addr == 0)
 		  {
-		    (void)record_label ((char*)$2.p, current_data_pc (), 1);
+		    (void)record_label ((char*)$2.p, current_data_pc ());
 		    free ((char*)$2.p);
 		  }
 		  increment_data_pc ($3.i);
@@ -2159,6 +2164,7 @@ ASM_DIRECTIVE:	Y_ALIAS_DIR	Y_REG	Y_REG
 		  data_dir = true; text_dir = false;
 		  enable_data_alignment ();
 		  set_data_pc ($2.i);
+		  data_address_given = true;
 		}
 
 
@@ -2175,6 +2181,7 @@ ASM_DIRECTIVE:	Y_ALIAS_DIR	Y_REG	Y_REG
 		  data_dir = true; text_dir = false;
 		  enable_data_alignment ();
 		  set_data_pc ($2.i);
+		  data_address_given = true;
 		}
 
 
@@ -2255,8 +2262,7 @@ ASM_DIRECTIVE:	Y_ALIAS_DIR	Y_REG	Y_REG
 	|	Y_LABEL_DIR	ID
 		{
 		  (void)record_label ((char*)$2.p,
-				      text_dir ? current_text_pc () : current_data_pc (),
-				      1);
+				      text_dir ? current_text_pc () : current_data_pc ());
 		  free ((char*)$2.p);
 		}
 
@@ -2298,6 +2304,7 @@ ASM_DIRECTIVE:	Y_ALIAS_DIR	Y_REG	Y_REG
 		  data_dir = true; text_dir = false;
 		  enable_data_alignment ();
 		  set_data_pc ($2.i);
+		  data_address_given = true;
 		}
 
 
@@ -2314,6 +2321,7 @@ ASM_DIRECTIVE:	Y_ALIAS_DIR	Y_REG	Y_REG
 		  data_dir = true; text_dir = false;
 		  enable_data_alignment ();
 		  set_data_pc ($2.i);
+		  data_address_given = true;
 		}
 
 
@@ -2354,6 +2362,7 @@ ASM_DIRECTIVE:	Y_ALIAS_DIR	Y_REG	Y_REG
 		  data_dir = false; text_dir = true;
 		  enable_data_alignment ();
 		  set_text_pc ($2.i);
+		  text_address_given = true;
 		}
 
 
@@ -2370,6 +2379,7 @@ ASM_DIRECTIVE:	Y_ALIAS_DIR	Y_REG	Y_REG
 		  data_dir = false; text_dir = true;
 		  enable_data_alignment ();
 		  set_text_pc ($2.i);
+		  text_address_given = true;
 		}
 
 
@@ -2671,7 +2681,7 @@ fix_current_label_address (mem_addr new_addr)
 
   for (l = this_line_labels; l != NULL; l = l->tail)
     {
-      l->head->addr = new_addr;
+      set_label_address (l->head, new_addr);
     }
   clear_labels ();
 }
@@ -2695,7 +2705,6 @@ clear_labels ()
 
   for ( ; this_line_labels != NULL; this_line_labels = n)
     {
-      resolve_label_uses (this_line_labels->head);
       n = this_line_labels->tail;
       free (this_line_labels);
     }
@@ -2892,6 +2901,9 @@ initialize_parser (char *file_name)
   only_id = 0;
   data_dir = false;
   text_dir = true;
+  parse_warning_occurred = false;
+  text_address_given = false;
+  data_address_given = false;
 }
 
 
@@ -2946,6 +2958,7 @@ yyerror (char *s)
 void
 yywarn (char *s)
 {
+  parse_warning_occurred = true;
   error ("spim: (parser) %s on line %d of file %s\n%s", s, line_no, input_file_name, erroneous_line ());
 }
 
@@ -49,6 +49,7 @@ extern mem_addr PC, nPC;
 /* Argument passing registers */
 
 #define REG_V0		2
+#define REG_V1		3
 #define REG_A0		4
 #define REG_A1		5
 #define REG_A2		6
@@ -85,7 +86,7 @@ extern reg_word CCR[4][32], CPR[4][32];
 
 /* Count register: */
 #define CP0_Count_Reg	9
-#define CP0_Count	(CPR[0][CP0_Count_Reg]) /* ToDo */
+#define CP0_Count	(CPR[0][CP0_Count_Reg]) /* Ticks once per instruction */
 
 /* Compare register: */
 #define CP0_Compare_Reg	11
@@ -157,6 +158,22 @@ extern reg_word CCR[4][32], CPR[4][32];
 			 | CP0_Config_AR	\
 			 | CP0_Config_MT)
 
+/* Performance counter register.  SPIM does not implement the select field
+   of mfc0/mtc0, so one register does the work of the control/counter
+   pairs: writing it selects an event and reading it returns that event's
+   count (low 32 bits, or high 32 bits if CP0_PerfCnt_High is set). */
+#define CP0_PerfCnt_Reg	25
+#define CP0_PerfCnt	(CPR[0][CP0_PerfCnt_Reg])
+#define CP0_PerfCnt_Event 0x0000000f
+#define CP0_PerfCnt_High 0x80000000
+#define CP0_PerfCnt_Mask (CP0_PerfCnt_Event | CP0_PerfCnt_High)
+/* Events: */
+#define PerfCnt_Instructions	0	/* Instructions executed */
+#define PerfCnt_Cycles		1	/* Estimated cycles */
+#define PerfCnt_Loads		2
+#define PerfCnt_Stores		3
+#define PerfCnt_Cache_Misses	4	/* Always 0: no cache is simulated */
+
 
 
 /* Floating Point Coprocessor (1) registers.
@@ -47,8 +47,6 @@
 #else
 #include <errno.h>
 #include <stdlib.h>
-#include <signal.h>
-#include <sys/time.h>
 #endif
 
 #include "spim.h"
@@ -61,9 +59,12 @@
 #include "parser_yacc.h"
 #include "syscall.h"
 #include "run.h"
+#include "stats.h"
 
 bool force_break = false;	/* For the execution env. to force an execution break */
 
+unsigned long long instructions_executed = 0;
+
 #ifdef _MSC_BUILD
 /* Disable MS VS warning about constant predicate in conditional. */
 #pragma warning(disable: 4127)
@@ -75,11 +76,6 @@ bool force_break = false;	/* For the execution env. to force an execution break
 static void bump_CP0_timer ();
 static void set_fpu_cc (int cond, int cc, int less, int equal, int unordered);
 static void signed_multiply (reg_word v1, reg_word v2);
-static void start_CP0_timer ();
-#ifdef _WIN32
-void CALLBACK timer_completion_routine(LPVOID lpArgToCompletionRoutine,
-				       DWORD dwTimerLowValue, DWORD dwTimerHighValue);
-#endif
 static void unsigned_multiply (reg_word v1, reg_word v2);
 
 
@@ -197,10 +193,7 @@ run_spim (mem_addr initial_PC, int steps_to_run, bool display)
   if (!bare_machine && mapped_io)
     next_step = IO_INTERVAL;
   else
-    next_step = steps_to_run;	/* Run to completion */
-
-  /* Start a timer running */
-  start_CP0_timer();
+    next_step = CONSOLE_CHECK_INTERVAL;
 
   for (step_size = MIN (next_step, steps_to_run);
        steps_to_run > 0;
@@ -210,7 +203,7 @@ run_spim (mem_addr initial_PC, int steps_to_run, bool display)
 	/* Every IO_INTERVAL steps, check if memory-mapped IO registers
 	   have changed. */
 	check_memory_mapped_IO ();
-      /* else run inner loop for all steps */
+      check_console_output ();
 
       if ((CP0_Status & CP0_Status_IE)
 	  && !(CP0_Status & CP0_Status_EXL)
@@ -235,27 +228,6 @@ run_spim (mem_addr initial_PC, int steps_to_run, bool display)
 
 	  R[0] = 0;		/* Maintain invariant value */
 
-#ifdef _WIN32
-	  SleepEx(0, TRUE);	      /* Put thread in awaitable state for WaitableTimer */
-#else
-	  {
-	    /* Poll for timer expiration */
-	    struct itimerval time;
-	    if (-1 == getitimer (ITIMER_REAL, &time))
-	      {
-		perror ("getitmer failed");
-	      }
-	    if (time.it_value.tv_usec == 0 && time.it_value.tv_sec == 0)
-	      {
-		/* Timer expired */
-		bump_CP0_timer ();
-
-		/* Restart timer for next interval */
-                start_CP0_timer ();
-	      }
-	  }
-#endif
-
 	  exception_occurred = 0;
 	  inst = read_mem_inst (PC);
 	  if (exception_occurred) /* In reading instruction */
@@ -264,7 +236,19 @@ run_spim (mem_addr initial_PC, int steps_to_run, bool display)
 	      handle_exception ();
 	      continue;
 	    }
-	  else if (inst == NULL)
+
+	  if (inst != NULL && OPCODE (inst) == Y_BREAK_OP && RD (inst) == 1)
+	    {
+	      /* Debugger breakpoint.  If its condition is false or its
+		 ignore count has not run out, execute the instruction
+		 under it instead of stopping. */
+	      instruction *bkpt_inst = breakpoint_reached (PC);
+
+	      if (bkpt_inst != NULL)
+		inst = bkpt_inst;
+	    }
+
+	  if (inst == NULL)
 	    {
 	      run_error ("Attempt to execute non-instruction at 0x%08x\n", PC);
 	      return false;
@@ -277,6 +261,10 @@ run_spim (mem_addr initial_PC, int steps_to_run, bool display)
 	      return false;
 	    }
 
+	  instructions_executed += 1;
+	  opcode_counts[OPCODE (inst)] += 1;
+	  bump_CP0_timer ();
+
 	  if (display)
 	    print_inst (PC);
 
@@ -724,7 +712,16 @@ run_spim (mem_addr initial_PC, int steps_to_run, bool display)
 	      }
 
 	    case Y_MFC0_OP:
-	      R[RT (inst)] = CPR[0][FS (inst)];
+	      if (FS (inst) == CP0_PerfCnt_Reg)
+		{
+		  unsigned long long count =
+		    perf_counter_value (CP0_PerfCnt & CP0_PerfCnt_Event);
+
+		  R[RT (inst)] = (reg_word) ((CP0_PerfCnt & CP0_PerfCnt_High)
+					     ? count >> 32 : count);
+		}
+	      else
+		R[RT (inst)] = CPR[0][FS (inst)];
 	      break;
 
 	    case Y_MFC2_OP:
@@ -796,6 +793,10 @@ run_spim (mem_addr initial_PC, int steps_to_run, bool display)
 		  CPR[0][FS (inst)] &= CP0_Config_Mask;
 		  break;
 
+		case CP0_PerfCnt_Reg:
+		  CPR[0][FS (inst)] &= CP0_PerfCnt_Mask;
+		  break;
+
 		default:
 		  break;
 		}
@@ -1636,20 +1637,8 @@ run_spim (mem_addr initial_PC, int steps_to_run, bool display)
 }
 
 
-#ifdef _WIN32
-void CALLBACK
-timer_completion_routine(LPVOID lpArgToCompletionRoutine, DWORD dwTimerLowValue, DWORD dwTimerHighValue)
-{
-  lpArgToCompletionRoutine = lpArgToCompletionRoutine;
-  dwTimerLowValue = dwTimerLowValue;
-  dwTimerHighValue = dwTimerHighValue;
-  bump_CP0_timer ();
-}
-#endif
-
-
-/* Increment CP0 Count register and test if it matches the Compare
-   register. If so, cause an interrupt. */
+/* Increment CP0 Count register, once per instruction executed, and test
+   if it matches the Compare register. If so, cause an interrupt. */
 
 static void
 bump_CP0_timer ()
@@ -1662,63 +1651,6 @@ bump_CP0_timer ()
 }
 
 
-static void
-start_CP0_timer ()
-{
-#ifdef _WIN32
-  HANDLE timer = CreateWaitableTimer(NULL, TRUE, TEXT("SPIMTimer"));
-  if (NULL == timer)
-    {
-      error ("CreateWaitableTimer failed");
-    }
-  else
-    {
-      LARGE_INTEGER interval;
-      interval.QuadPart = -10000 * TIMER_TICK_MS;  /* Unit is 100 nsec */
-
-      if (!SetWaitableTimer (timer, &interval, 1, timer_completion_routine, 0, FALSE))
-	{
-	  error ("SetWaitableTimer failed");
-	}
-    }
-#else
-  /* Should use ITIMER_VIRTUAL delivering SIGVTALRM, but that does not seem
-     to work under Cygwin, so we'll adopt the lowest common denominator and
-     use real time.
-
-     We ignore the resulting signal, however, and read the timer with getitimer,
-     since signals interrupt I/O calls, such as read, and make user
-     interaction with SPIM work very poorly. Since speed isn't an important
-     aspect of SPIM, polling isn't a big deal. */
-  if (SIG_ERR == signal (SIGALRM, SIG_IGN))
-    {
-      perror ("signal failed");
-    }
-  else
-    {
-        struct itimerval time;
-        if (-1 == getitimer (ITIMER_REAL, &time))
-        {
-            perror ("getitmer failed");
-        }
-        if (time.it_value.tv_usec == 0 && time.it_value.tv_sec == 0)
-        {
-            /* Timer is expired or has not been started.
-               Start a non-periodic timer for TIMER_TICK_MS microseconds. */
-            time.it_interval.tv_sec = 0;
-            time.it_interval.tv_usec = 0;
-            time.it_value.tv_sec = 0;
-            time.it_value.tv_usec = TIMER_TICK_MS * 1000;
-            if (-1 == setitimer (ITIMER_REAL, &time, NULL))
-            {
-                perror ("setitmer failed");
-            }
-        }
-    }
-#endif
-}
-
-
 /* Multiply two 32-bit numbers, V1 and V2, to produce a 64 bit result in
    the HI/LO registers.	 The algorithm is high-school math:
 
@@ -31,6 +31,12 @@
 */
 
 
+/* Exported variables: */
+
+/* Number of instructions executed since the world was initialized. */
+extern unsigned long long instructions_executed;
+
+
 /* Exported functions: */
 
 bool run_spim (mem_addr initial_PC, register int steps, bool display);
@@ -34,12 +34,13 @@
 /* Exported functions (besides yylex): */
 
 void initialize_scanner (FILE *in_file);
+void initialize_text_scanner (char *text, int length);
 void push_scanner (FILE *in_file);
 void pop_scanner ();
 char* erroneous_line ();
 void scanner_start_line ();
 int register_name_to_number (char *name);
-char *source_line ();
+char *source_line (int *length, int *line);
 int yylex ();
 
 /* Exported Variables: */
@@ -50,3 +50,27 @@
 #define CLOSE_SYSCALL		16
 
 #define EXIT2_SYSCALL		17
+
+/* Host implementations of common library routines on guest memory.
+   $a0, $a1, $a2 hold the arguments in C order. */
+
+#define MEMCPY_SYSCALL		60
+#define MEMSET_SYSCALL		61
+#define STRLEN_SYSCALL		62
+#define STRCMP_SYSCALL		63
+#define MEMCMP_SYSCALL		64
+
+/* Map a file ($a0 = name, $a1 = MMAP_READ_ONLY or MMAP_PRIVATE_COPY) into
+   memory.  Returns its address in $v0 (-1 on failure) and its length in
+   $v1. */
+
+#define MMAP_SYSCALL		65
+
+#define MMAP_READ_ONLY		0
+#define MMAP_PRIVATE_COPY	1
+
+/* 64-bit counters, returned with the low word in $v0 and the high word in
+   $v1: host monotonic time in nanoseconds, and instructions executed. */
+
+#define TIME_NS_SYSCALL		66
+#define INST_COUNT_SYSCALL	67
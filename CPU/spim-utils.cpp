@@ -35,6 +35,14 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include "spim.h"
 #include "version.h"
@@ -49,6 +57,11 @@
 #include "parser_yacc.h"
 #include "run.h"
 #include "sym-tbl.h"
+#include "bkpt-cond.h"
+#include "stats.h"
+#include "image.h"
+#include "elf-load.h"
+#include "syscall.h"
 
 
 /* Internal functions: */
@@ -56,6 +69,60 @@
 static mem_addr copy_int_to_stack (int n);
 static mem_addr copy_str_to_stack (char *s);
 static void delete_all_breakpoints ();
+static struct bkptrec *find_breakpoint (mem_addr addr);
+static char *map_source_file (char *name, int *length);
+static void unmap_source_files ();
+
+
+/* Entry point of a loaded executable, or 0 to start at the
+   DEFAULT_RUN_LOCATION label. */
+
+static mem_addr program_entry = 0;
+
+
+/* Instructions, expressions, labels, and label uses that the assembler
+   and loaders produce live as long as the program does, so they are
+   allocated from an arena of large blocks and released together when
+   the world is reinitialized.  Objects freed before then go on a free
+   list for their size and are reused. */
+
+#define ARENA_MIN_BLOCK (64 * K)
+
+#define ARENA_MAX_BLOCK (16 * K * K)
+
+#define ARENA_ALIGN 8
+
+#define ARENA_FREE_LISTS 16	/* Sizes up to 16 * ARENA_ALIGN bytes */
+
+typedef struct arena_block
+{
+  struct arena_block *next;
+  double pad;			/* Align the storage that follows */
+} arena_block;
+
+static arena_block *arena_blocks = NULL;
+
+static char *arena_next = NULL;	/* Next free byte in newest block */
+
+static char *arena_limit = NULL; /* End of newest block */
+
+static int arena_block_size = ARENA_MIN_BLOCK;
+
+static void *arena_free_lists [ARENA_FREE_LISTS];
+
+
+/* Assembly files are mapped and scanned in place, and the source lines
+   of their instructions point into the mappings, so the files stay
+   mapped until the world is reinitialized. */
+
+typedef struct source_map_rec
+{
+  char *addr;
+  size_t size;
+  struct source_map_rec *next;
+} source_map;
+
+static source_map *source_maps = NULL;
 
 
 int exception_occurred;
@@ -92,9 +159,16 @@ initialize_world (char* exception_file_names, bool print_message)
 	       initial_stack_size, initial_stack_limit,
 	       initial_k_text_size,
 	       initial_k_data_size, initial_k_data_limit);
+  unmap_images ();
+  unmap_source_files ();
+  initialize_symbol_table ();
+  release_arena ();
   initialize_registers ();
+  instructions_executed = 0;
+  clear_opcode_stats ();
+  clear_syscall_stats ();
+  program_entry = 0;
   initialize_inst_tables ();
-  initialize_symbol_table ();
   k_text_begins_at_point (K_TEXT_BOT);
   k_data_begins_at_point (K_DATA_BOT);
   data_begins_at_point (DATA_BOT);
@@ -104,6 +178,8 @@ initialize_world (char* exception_file_names, bool print_message)
     {
       bool old_bare = bare_machine;
       bool old_accept = accept_pseudo_insts;
+      bool from_image;
+      bool assembled_ok = true;
       char *filename;
       char *files;
 
@@ -111,14 +187,25 @@ initialize_world (char* exception_file_names, bool print_message)
       bare_machine = false;     /* Exception handler uses extended machine */
       accept_pseudo_insts = true;
 
+      /* Use the saved image of the handler, if it is current. */
+      from_image = install_handler_image (exception_file_names);
+
       /* strtok modifies the string, so we must back up the string prior to use. */
       if ((files = strdup (exception_file_names)) == NULL)
          fatal_error ("Insufficient memory to complete.\n");
 
       for (filename = strtok (files, ";"); filename != NULL; filename = strtok (NULL, ";"))
          {
-            if (!read_assembly_file (filename))
-               fatal_error ("Cannot read exception handler: %s\n", filename);
+            if (!from_image)
+              {
+                /* A cached file is installed without the parser, which
+                   would otherwise reset this flag. */
+                parse_warning_occurred = false;
+                if (!read_assembly_file (filename, NULL))
+                  fatal_error ("Cannot read exception handler: %s\n", filename);
+                /* Set by an error or warning on any line of the file. */
+                assembled_ok = assembled_ok && !parse_warning_occurred;
+              }
 
             if (print_message)
                 write_output (message_out, "Loaded: %s\n", filename);
@@ -126,6 +213,9 @@ initialize_world (char* exception_file_names, bool print_message)
 
       free (files);
 
+      if (!from_image && assembled_ok)
+        write_handler_image (exception_file_names);
+
       /* Restore machine state */
       bare_machine = old_bare;
       accept_pseudo_insts = old_accept;
@@ -133,7 +223,7 @@ initialize_world (char* exception_file_names, bool print_message)
       if (!bare_machine)
       {
 	(void)make_label_global ("main"); /* In case .globl main forgotten */
-	(void)record_label ("main", 0, 0);
+	(void)record_label ("main", 0);
       }
     }
   initialize_scanner (stdin);
@@ -182,41 +272,197 @@ initialize_registers ()
 }
 
 
-/* Read file NAME, which should contain assembly code. Return true if
-   successful and false otherwise. */
+/* Read file NAME, which should contain assembly code, a program image,
+   or a MIPS32 ELF executable. Return true if successful and false
+   otherwise.  Assembly code is installed from the cache if the same
+   file was assembled at the same point before.  If SCANNED is not NULL,
+   set *SCANNED to true if the file was pushed on the scanner's input
+   (and so must be popped by the caller). */
 
 bool
-read_assembly_file (char *name)
+read_assembly_file (char *name, bool *scanned)
 {
-  FILE *file = fopen (name, "rt");
+  FILE *file;
+  char *text;
+  int length;
+
+  if (scanned != NULL)
+    *scanned = false;
+
+  if (is_elf_file (name))
+    return (read_elf_file (name));
+  if (is_program_image (name))
+    return (read_program_image (name));
+  if (read_cached_assembly (name))
+    {
+      end_of_assembly_file ();
+      return true;
+    }
 
-  if (file == NULL)
+  /* Scan the file in place if it can be mapped. */
+  text = map_source_file (name, &length);
+  if (text != NULL)
+    {
+      file = NULL;
+      initialize_text_scanner (text, length);
+    }
+  else if ((file = fopen (name, "rt")) != NULL)
+    initialize_scanner (file);
+  else
     {
       error ("Cannot open file: `%s'\n", name);
       return false;
     }
-  else
+  if (scanned != NULL)
+    *scanned = true;
+
+  initialize_parser (name);
+
+  while (!yyparse ()) ;
+
+  if (file != NULL)
+    fclose (file);
+  flush_local_labels (!parse_error_occurred);
+  end_of_assembly_file ();
+  if (!parse_warning_occurred && !text_address_given && !data_address_given)
+    write_cached_assembly ();
+  return true;
+}
+
+
+/* Map file NAME privately and writably, followed by the end marker and
+   null bytes that initialize_text_scanner requires, and set *LENGTH to
+   its length.  Return NULL if the file is not a regular file or cannot
+   be mapped. */
+
+static char *
+map_source_file (char *name, int *length)
+{
+#ifdef _WIN32
+  return (NULL);
+#else
+  source_map *m;
+  struct stat st;
+  size_t page = (size_t) sysconf (_SC_PAGESIZE);
+  size_t size, map_size;
+  char *addr;
+  int fd;
+
+  fd = open (name, O_RDONLY);
+  if (fd < 0)
+    return (NULL);
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode)
+      || st.st_size == 0 || st.st_size > INT_MAX - 3)
+    {
+      close (fd);
+      return (NULL);
+    }
+  size = (size_t) st.st_size;
+
+  /* Reserve zeroed pages for the file and the three bytes after it,
+     then map the file over the start of them. */
+  map_size = (size + 3 + page - 1) / page * page;
+  addr = (char *) mmap (NULL, map_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED)
+    {
+      close (fd);
+      return (NULL);
+    }
+  if (mmap (addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+	    fd, 0) == MAP_FAILED)
     {
-      initialize_scanner (file);
-      initialize_parser (name);
+      munmap (addr, map_size);
+      close (fd);
+      return (NULL);
+    }
+  close (fd);
+  addr[size] = '\001';
 
-      while (!yyparse ()) ;
+  m = (source_map *) xmalloc (sizeof (source_map));
+  m->addr = addr;
+  m->size = map_size;
+  m->next = source_maps;
+  source_maps = m;
 
-      fclose (file);
-      flush_local_labels (!parse_error_occurred);
-      end_of_assembly_file ();
-      return true;
+  *length = (int) size;
+  return (addr);
+#endif
+}
+
+
+/* Unmap all assembly files.  Called when the world is reinitialized,
+   since the instructions that refer to them have been discarded. */
+
+static void
+unmap_source_files ()
+{
+  while (source_maps != NULL)
+    {
+      source_map *m = source_maps;
+
+#ifndef _WIN32
+      munmap (m->addr, m->size);
+#endif
+      source_maps = m->next;
+      free (m);
     }
 }
 
 
+/* Map file NAME read only, for the life of the process, and set *LENGTH
+   to its length.  Used for console input read from a file.  Return NULL
+   if it is not a regular file or cannot be mapped. */
+
+char *
+map_input_file (char *name, int *length)
+{
+#ifdef _WIN32
+  return (NULL);
+#else
+  struct stat st;
+  void *addr;
+  int fd;
+
+  fd = open (name, O_RDONLY);
+  if (fd < 0)
+    return (NULL);
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode) || st.st_size > INT_MAX)
+    {
+      close (fd);
+      return (NULL);
+    }
+
+  *length = (int) st.st_size;
+  if (st.st_size == 0)
+    addr = (void *) "";		/* mmap rejects an empty mapping */
+  else
+    addr = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  return (addr == MAP_FAILED ? NULL : (char *) addr);
+#endif
+}
+
+
 mem_addr
 starting_address ()
 {
+  if (program_entry != 0)
+    return (program_entry);
   return (find_symbol_address (DEFAULT_RUN_LOCATION));
 }
 
 
+/* Start the program at ADDR instead of the DEFAULT_RUN_LOCATION label.
+   Used for executables with their own entry point. */
+
+void
+set_starting_address (mem_addr addr)
+{
+  program_entry = addr;
+}
+
+
 #define MAX_ARGS 10000
 
 /* Initialize the SPIM stack from a string containing the command line. */
@@ -345,16 +591,19 @@ run_program (mem_addr pc, int steps, bool display, bool cont_bkpt, bool* continu
     {
       mem_addr addr = PC == 0 ? pc : PC;
 
-      delete_breakpoint (addr);
+      /* Execute the instruction under the breakpoint in place, so the
+	 breakpoint keeps its condition and counts. */
+      set_mem_inst (addr, breakpoint_instruction (addr));
       exception_occurred = 0;
       *continuable = run_spim (addr, 1, display);
-      add_breakpoint (addr);
+      set_breakpoint (addr);
       steps -= 1;
       pc = PC;
     }
 
   exception_occurred = 0;
   *continuable = run_spim (pc, steps, display);
+  flush_console_output ();
   if (exception_occurred && CP0_ExCode == ExcCode_Bp)
   {
       /* Turn off EXL bit, so subsequent interrupts set EPC since the break is
@@ -368,12 +617,17 @@ run_program (mem_addr pc, int steps, bool display, bool cont_bkpt, bool* continu
 
 
 /* Record of where a breakpoint was placed and the instruction previously
-   in memory. */
+   in memory.  A breakpoint with a condition only stops when its condition
+   is true; an ignore count skips that many of those stops. */
 
 typedef struct bkptrec
 {
   mem_addr addr;
   instruction *inst;
+  bkpt_cond *cond;		/* Compiled condition or NULL */
+  char *cond_text;		/* Condition as typed by the user */
+  int ignore_count;		/* Stops still to skip */
+  int hit_count;		/* Times the breakpoint has stopped or been ignored */
   struct bkptrec *next;
 } bkpt;
 
@@ -386,7 +640,7 @@ static bkpt *bkpts = NULL;
 void
 add_breakpoint (mem_addr addr)
 {
-  bkpt *rec = (bkpt *) xmalloc (sizeof (bkpt));
+  bkpt *rec = (bkpt *) zmalloc (sizeof (bkpt));
 
   rec->next = bkpts;
   rec->addr = addr;
@@ -423,6 +677,8 @@ delete_breakpoint (mem_addr addr)
 	else
 	  p->next = b->next;
 	n = b->next;
+	free_bkpt_condition (b->cond);
+	free (b->cond_text);
 	free (b);
 	b = n;
 	deleted_one = 1;
@@ -442,12 +698,101 @@ delete_all_breakpoints ()
   for (b = bkpts, n = NULL; b != NULL; b = n)
     {
       n = b->next;
+      free_bkpt_condition (b->cond);
+      free (b->cond_text);
       free (b);
     }
   bkpts = NULL;
 }
 
 
+static bkpt *
+find_breakpoint (mem_addr addr)
+{
+  bkpt *b;
+
+  for (b = bkpts; b != NULL; b = b->next)
+    if (b->addr == addr)
+      return (b);
+  return (NULL);
+}
+
+
+/* Make the breakpoint at ADDR conditional on the expression TEXT, or
+   unconditional if TEXT is NULL.  Return false, leaving the breakpoint
+   unchanged, if there is no breakpoint or TEXT does not compile. */
+
+bool
+set_breakpoint_condition (mem_addr addr, char *text)
+{
+  bkpt *b = find_breakpoint (addr);
+  bkpt_cond *cond = NULL;
+
+  if (b == NULL)
+    {
+      error ("No breakpoint at 0x%08x\n", addr);
+      return false;
+    }
+  if (text != NULL && (cond = compile_bkpt_condition (text)) == NULL)
+    return false;
+
+  free_bkpt_condition (b->cond);
+  free (b->cond_text);
+  b->cond = cond;
+  b->cond_text = (text == NULL ? NULL : str_copy (text));
+  return true;
+}
+
+
+/* Skip the next COUNT stops at the breakpoint at ADDR. */
+
+void
+set_breakpoint_ignore_count (mem_addr addr, int count)
+{
+  bkpt *b = find_breakpoint (addr);
+
+  if (b == NULL)
+    error ("No breakpoint at 0x%08x\n", addr);
+  else
+    b->ignore_count = (count < 0 ? 0 : count);
+}
+
+
+/* Return the instruction hidden by the breakpoint at ADDR. */
+
+instruction *
+breakpoint_instruction (mem_addr addr)
+{
+  bkpt *b = find_breakpoint (addr);
+
+  return (b == NULL ? NULL : b->inst);
+}
+
+
+/* Called when execution reaches the breakpoint at ADDR.  Return NULL if
+   execution should stop, or else the instruction under the breakpoint,
+   which execution should continue with. */
+
+instruction *
+breakpoint_reached (mem_addr addr)
+{
+  bkpt *b = find_breakpoint (addr);
+
+  if (b == NULL)
+    return (NULL);
+  if (b->cond != NULL && !eval_bkpt_condition (b->cond))
+    return (b->inst);
+
+  b->hit_count += 1;
+  if (b->ignore_count > 0)
+    {
+      b->ignore_count -= 1;
+      return (b->inst);
+    }
+  return (NULL);
+}
+
+
 /* List all breakpoints. */
 
 void
@@ -457,12 +802,20 @@ list_breakpoints ()
 
   if (bkpts)
     for (b = bkpts;  b != NULL; b = b->next)
-      write_output (message_out, "Breakpoint at 0x%08x\n", b->addr);
+      {
+	write_output (message_out, "Breakpoint at 0x%08x", b->addr);
+	if (b->cond_text != NULL)
+	  write_output (message_out, " if %s", b->cond_text);
+	write_output (message_out, " (hit %d times", b->hit_count);
+	if (b->ignore_count > 0)
+	  write_output (message_out, ", ignore next %d", b->ignore_count);
+	write_output (message_out, ")\n");
+      }
   else
     write_output (message_out, "No breakpoints set\n");
 }
 
-
+
 
 /* Utility routines */
 
@@ -623,3 +976,77 @@ zmalloc (int size)
   memclr (z, size);
   return (z);
 }
+
+
+/* Allocate a zero'ed block of SIZE bytes from the arena. */
+
+void *
+arena_alloc (int size)
+{
+  int list;
+  void *p;
+
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+  list = size / ARENA_ALIGN - 1;
+  if (list < ARENA_FREE_LISTS && arena_free_lists [list] != NULL)
+    {
+      p = arena_free_lists [list];
+      arena_free_lists [list] = *(void **) p;
+    }
+  else
+    {
+      if (arena_next == NULL || arena_limit - arena_next < size)
+	{
+	  int block_size = MAX (arena_block_size, size);
+	  arena_block *b = (arena_block *) xmalloc (sizeof (arena_block) + block_size);
+
+	  b->next = arena_blocks;
+	  arena_blocks = b;
+	  arena_next = (char *) (b + 1);
+	  arena_limit = arena_next + block_size;
+	  if (arena_block_size < ARENA_MAX_BLOCK)
+	    arena_block_size *= 2;
+	}
+      p = arena_next;
+      arena_next += size;
+    }
+
+  memclr (p, size);
+  return (p);
+}
+
+
+/* Return the SIZE bytes at P, which came from arena_alloc, for reuse. */
+
+void
+arena_free (void *p, int size)
+{
+  int list = (size + ARENA_ALIGN - 1) / ARENA_ALIGN - 1;
+
+  if (p != NULL && list < ARENA_FREE_LISTS)
+    {
+      *(void **) p = arena_free_lists [list];
+      arena_free_lists [list] = p;
+    }
+}
+
+
+/* Free everything allocated from the arena. */
+
+void
+release_arena ()
+{
+  int i;
+
+  while (arena_blocks != NULL)
+    {
+      arena_block *b = arena_blocks;
+
+      arena_blocks = b->next;
+      free (b);
+    }
+  arena_next = arena_limit = NULL;
+  arena_block_size = ARENA_MIN_BLOCK;
+  for (i = 0; i < ARENA_FREE_LISTS; i++)
+    arena_free_lists [i] = NULL;
+}
@@ -46,6 +46,10 @@ typedef struct
 /* Exported functions: */
 
 void add_breakpoint (mem_addr addr);
+void *arena_alloc (int size);
+void arena_free (void *p, int size);
+struct inst_s *breakpoint_instruction (mem_addr addr);
+struct inst_s *breakpoint_reached (mem_addr addr);
 void delete_breakpoint (mem_addr addr);
 void format_data_segs (str_stream *ss);
 void format_insts (str_stream *ss, mem_addr from, mem_addr to);
@@ -56,10 +60,15 @@ void initialize_stack (const char *command_line);
 void initialize_run_stack (int argc, char **argv);
 void initialize_world (char *exception_file_names, bool print_message);
 void list_breakpoints ();
+char *map_input_file (char *name, int *length);
 name_val_val *map_int_to_name_val_val (name_val_val tbl[], int tbl_len, int num);
 name_val_val *map_string_to_name_val_val (name_val_val tbl[], int tbl_len, char *id);
-bool read_assembly_file (char *name);
+bool read_assembly_file (char *name, bool *scanned);
+void release_arena ();
 bool run_program (mem_addr pc, int steps, bool display, bool cont_bkpt, bool* continuable);
+bool set_breakpoint_condition (mem_addr addr, char *text);
+void set_breakpoint_ignore_count (mem_addr addr, int count);
+void set_starting_address (mem_addr addr);
 mem_addr starting_address ();
 char *str_copy (char *str);
 void write_startup_message ();
@@ -199,6 +199,11 @@ typedef uint32 /*@alt int @*/ mem_addr;
 
 #define IO_INTERVAL 100
 
+/* Interval (in instructions) at which output buffered by the print
+   syscalls is checked and, if it has waited long enough, written. */
+
+#define CONSOLE_CHECK_INTERVAL 65536
+
 
 /* Number of IO_INTERVALs that a character remains in receiver buffer,
    even if another character is available. */
@@ -210,11 +215,6 @@ typedef uint32 /*@alt int @*/ mem_addr;
 
 #define TRANS_LATENCY 100
 
-
-/* Iterval (milliseconds) for the hardware timer in CP0. */
-
-#define TIMER_TICK_MS 10	/* 100 times per second */
-
 
 
 /* A port is either a Unix file descriptor (an int) or a FILE* pointer. */
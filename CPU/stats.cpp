@@ -0,0 +1,314 @@
+/* SPIM S20 MIPS simulator.
+   Instruction-mix statistics.
+
+   Copyright (c) 1990-2020, James R. Larus.
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without modification,
+   are permitted provided that the following conditions are met:
+
+   Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation and/or
+   other materials provided with the distribution.
+
+   Neither the name of the James R. Larus nor the names of its contributors may be
+   used to endorse or promote products derived from this software without specific
+   prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+   GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+   LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+   OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spim.h"
+#include "string-stream.h"
+#include "spim-utils.h"
+#include "inst.h"
+#include "reg.h"
+#include "run.h"
+#include "parser_yacc.h"
+#include "stats.h"
+
+
+/* Classes of instructions reported in the instruction mix. */
+
+enum inst_class
+{
+  ALU_CLASS, LOAD_STORE_CLASS, BRANCH_CLASS, JUMP_CLASS, FP_CLASS,
+  SYSCALL_CLASS, OTHER_CLASS, CLASS_COUNT
+};
+
+static const char *class_names[CLASS_COUNT] =
+{
+  "ALU", "load/store", "branch", "jump", "FP", "syscall", "other"
+};
+
+
+/* Local functions: */
+
+static int compare_by_count (const void *p1, const void *p2);
+static int inst_class (name_val_val *entry);
+static int inst_latency (name_val_val *entry);
+
+
+/* Local variables: */
+
+/* Every machine instruction and pseudo-op, from op.h. */
+
+static name_val_val op_tbl [] = {
+#undef OP
+#define OP(NAME, OPCODE, TYPE, R_OPCODE) {NAME, OPCODE, (int)TYPE},
+#include "op.h"
+};
+
+#define OP_TBL_LEN (int) (sizeof (op_tbl) / sizeof (name_val_val))
+
+/* Number of entries in OPCODE_COUNTS: one more than largest opcode. */
+static int opcode_limit = 0;
+
+
+unsigned long long *opcode_counts = NULL;
+
+
+
+/* Reset all opcode counts to zero. */
+
+void
+clear_opcode_stats ()
+{
+  int i;
+
+  if (opcode_counts == NULL)
+    {
+      for (i = 0; i < OP_TBL_LEN; i++)
+	if (op_tbl[i].value1 >= opcode_limit)
+	  opcode_limit = op_tbl[i].value1 + 1;
+      opcode_counts = (unsigned long long *) xmalloc (opcode_limit * sizeof (unsigned long long));
+    }
+  memset (opcode_counts, 0, opcode_limit * sizeof (unsigned long long));
+}
+
+
+/* Print the number of instructions executed in each class and for each
+   opcode, most frequent first. */
+
+void
+format_opcode_stats (str_stream *ss)
+{
+  unsigned long long class_counts[CLASS_COUNT];
+  unsigned long long total = 0;
+  name_val_val *sorted[sizeof (op_tbl) / sizeof (name_val_val)];
+  int n_sorted = 0;
+  int i;
+
+  memset (class_counts, 0, sizeof (class_counts));
+  if (opcode_counts == NULL)
+    clear_opcode_stats ();
+
+  for (i = 0; i < OP_TBL_LEN; i++)
+    {
+      unsigned long long count = opcode_counts[op_tbl[i].value1];
+
+      if (count != 0 && op_tbl[i].value2 != ASM_DIR && op_tbl[i].value2 != PSEUDO_OP)
+	{
+	  class_counts[inst_class (&op_tbl[i])] += count;
+	  total += count;
+	  sorted[n_sorted++] = &op_tbl[i];
+	}
+    }
+
+  ss_printf (ss, "Instruction mix (%llu instructions):\n", total);
+  for (i = 0; i < CLASS_COUNT; i++)
+    ss_printf (ss, "  %-12s %14llu %6.2f%%\n", class_names[i], class_counts[i],
+	       total == 0 ? 0.0 : 100.0 * class_counts[i] / total);
+
+  qsort (sorted, n_sorted, sizeof (name_val_val *), compare_by_count);
+  ss_printf (ss, "Opcodes:\n");
+  for (i = 0; i < n_sorted; i++)
+    ss_printf (ss, "  %-12s %14llu %6.2f%%\n", sorted[i]->name,
+	       opcode_counts[sorted[i]->value1],
+	       100.0 * opcode_counts[sorted[i]->value1] / total);
+}
+
+
+/* Return the current value of the performance counter for EVENT (one of
+   the PerfCnt_ values in reg.h).  Counts are derived from OPCODE_COUNTS
+   when read, so keeping them costs nothing while the program runs. */
+
+unsigned long long
+perf_counter_value (int event)
+{
+  unsigned long long total = 0;
+  int i;
+
+  if (event == PerfCnt_Instructions)
+    return (instructions_executed);
+  else if (event == PerfCnt_Cache_Misses)
+    return (0);			/* No cache is simulated */
+
+  if (opcode_counts == NULL)
+    clear_opcode_stats ();
+
+  for (i = 0; i < OP_TBL_LEN; i++)
+    {
+      name_val_val *entry = &op_tbl[i];
+      unsigned long long count = opcode_counts[entry->value1];
+
+      if (count == 0 || entry->value2 == ASM_DIR || entry->value2 == PSEUDO_OP)
+	continue;
+
+      switch (event)
+	{
+	case PerfCnt_Cycles:
+	  total += count * inst_latency (entry);
+	  break;
+
+	case PerfCnt_Loads:
+	  if (opcode_is_load (entry->value1))
+	    total += count;
+	  break;
+
+	case PerfCnt_Stores:
+	  if (opcode_is_store (entry->value1))
+	    total += count;
+	  break;
+
+	default:
+	  break;
+	}
+    }
+  return (total);
+}
+
+
+/* Sort opcodes by decreasing count, then by name. */
+
+static int
+compare_by_count (const void *p1, const void *p2)
+{
+  name_val_val *e1 = *(name_val_val **) p1;
+  name_val_val *e2 = *(name_val_val **) p2;
+  unsigned long long c1 = opcode_counts[e1->value1];
+  unsigned long long c2 = opcode_counts[e2->value1];
+
+  if (c1 != c2)
+    return (c1 > c2 ? -1 : 1);
+  return (strcmp (e1->name, e2->name));
+}
+
+
+static int
+inst_class (name_val_val *entry)
+{
+  int opcode = entry->value1;
+
+  switch (opcode)
+    {
+    case Y_SYSCALL_OP:
+      return (SYSCALL_CLASS);
+
+    case Y_JR_OP:
+    case Y_JR_HB_OP:
+    case Y_JALR_OP:
+    case Y_JALR_HB_OP:
+      return (JUMP_CLASS);
+
+    case Y_MFC1_OP:
+    case Y_MTC1_OP:
+    case Y_MFHC1_OP:
+    case Y_MTHC1_OP:
+    case Y_CFC1_OP:
+    case Y_CTC1_OP:
+      return (FP_CLASS);
+
+    case Y_MFC0_OP:
+    case Y_MTC0_OP:
+    case Y_CFC0_OP:
+    case Y_CTC0_OP:
+    case Y_MFC2_OP:
+    case Y_MTC2_OP:
+    case Y_CFC2_OP:
+    case Y_CTC2_OP:
+    case Y_MFHC2_OP:
+    case Y_MTHC2_OP:
+    case Y_DI_OP:
+    case Y_EI_OP:
+    case Y_RDPGPR_OP:
+    case Y_WRPGPR_OP:
+      return (OTHER_CLASS);
+
+    default:
+      break;
+    }
+
+  if (opcode_is_load_store (opcode))
+    return (LOAD_STORE_CLASS);
+  else if (opcode_is_branch (opcode))
+    return (BRANCH_CLASS);
+  else if (opcode_is_jump (opcode))
+    return (JUMP_CLASS);
+  else if (strchr (entry->name, '.') != NULL)
+    /* FP arithmetic, compares, conversions, and moves: add.d, c.lt.s, ... */
+    return (FP_CLASS);
+  else if (entry->value2 == NOARG_TYPE_INST)
+    /* break, eret, nop, sync, tlb operations, ... */
+    return (OTHER_CLASS);
+  else
+    return (ALU_CLASS);
+}
+
+
+/* Rough number of cycles an instruction takes on a simple in-order
+   pipeline: long-latency multiply, divide, and FP operations stall,
+   everything else issues in one cycle. */
+
+static int
+inst_latency (name_val_val *entry)
+{
+  switch (entry->value1)
+    {
+    case Y_MUL_OP:
+    case Y_MULT_OP:
+    case Y_MULTU_OP:
+    case Y_MADD_OP:
+    case Y_MADDU_OP:
+    case Y_MSUB_OP:
+    case Y_MSUBU_OP:
+      return (5);
+
+    case Y_DIV_OP:
+    case Y_DIVU_OP:
+      return (36);
+
+    case Y_DIV_S_OP:
+    case Y_DIV_D_OP:
+    case Y_SQRT_S_OP:
+    case Y_SQRT_D_OP:
+    case Y_RECIP_D_OP:
+    case Y_RSQRT_D_OP:
+      return (20);
+
+    default:
+      break;
+    }
+
+  if (strchr (entry->name, '.') != NULL)
+    return (4);
+  else
+    return (1);
+}
@@ -45,31 +45,83 @@
 
 /* Local functions: */
 
-static void get_hash (char *name, int *slot_no, label **entry);
+static int compare_label_addrs (const void *p1, const void *p2);
+static int compare_label_uses (const void *p1, const void *p2);
+static int find_slot (char *name, unsigned int hash);
+static void grow_label_table ();
+static unsigned int hash_name (char *name);
+static char *intern_name (char *name);
+static bool label_use_is_ready (label_use *u);
+static void remove_slot (int slot);
 static void resolve_a_label_sub (label *sym, instruction *inst, mem_addr pc);
+static void sort_labels_by_address ();
+
 
-
 
 /* Keep track of the memory location that a label represents.  If we
    see a reference to a label that is not yet defined, then record the
    reference so that we can patch up the instruction when the label is
-   defined.
+   defined.  References are kept in one vector and patched together at
+   the end of each file.
 
    At the end of a file, we flush the hash table of all non-global
-   labels so they can't be seen in other files.	 */
+   labels so they can't be seen in other files.
+
+   The table is open-addressed with linear probing and doubles when it
+   is more than half full.  Each slot caches the hash of its label's
+   name, so a probe rarely compares strings.  Names are interned in
+   blocks that are released together when the table is reinitialized. */
 
 
 static label *local_labels = NULL; /* Labels local to current file. */
 
 
-#define HASHBITS 30
+#define INITIAL_LABEL_TABLE_SIZE 1024 /* Must be a power of 2 */
 
-#define LABEL_HASH_TABLE_SIZE 8191
+#define NAME_BLOCK_SIZE 8192
 
 
 /* Map from name of a label to a label structure. */
 
-static label *label_hash_table [LABEL_HASH_TABLE_SIZE];
+static label **label_table = NULL;
+
+static unsigned int *label_hashes = NULL; /* Hash of name in each slot */
+
+static int label_table_size = 0;
+
+static int n_table_labels = 0;
+
+
+/* Labels in the table, sorted by address.  Rebuilt after a label is
+   added, removed, or moved (see set_label_address). */
+
+static label **labels_by_address = NULL;
+
+static bool labels_by_address_valid = false;
+
+
+/* Storage for interned label names. */
+
+typedef struct name_block
+{
+  struct name_block *next;
+  int used;
+  int size;
+  char bytes [1];		/* Actually SIZE bytes */
+} name_block;
+
+static name_block *name_blocks = NULL;
+
+
+/* Recorded uses of labels that were undefined at the time. */
+
+static label_use *label_uses = NULL;
+
+static int n_label_uses = 0;
+
+static int label_uses_size = 0;
+
+static int label_use_seq = 0;
 
 
 /* Initialize the symbol table by removing and freeing old entries. */
@@ -79,57 +131,153 @@ initialize_symbol_table ()
 {
   int i;
 
-  for (i = 0; i < LABEL_HASH_TABLE_SIZE; i ++)
-  {
-    label *x, *n;
+  /* The labels themselves are in the arena. */
+  for (i = 0; i < label_table_size; i ++)
+    label_table [i] = NULL;
+  n_table_labels = 0;
 
-    for (x = label_hash_table [i]; x != NULL; x = n)
+  while (name_blocks != NULL)
     {
-      free (x->name);
-      n = x->next;
-      free (x);
+      name_block *b = name_blocks;
+
+      name_blocks = b->next;
+      free (b);
     }
-    label_hash_table [i] = NULL;
-  }
+
+  if (labels_by_address != NULL)
+    free (labels_by_address);
+  labels_by_address = NULL;
+  labels_by_address_valid = false;
 
   local_labels = NULL;
+
+  /* The instructions that the uses point to are in the arena. */
+  n_label_uses = 0;
+  label_use_seq = 0;
 }
 
 
 
-/* Lookup for a label with the given NAME.  Set the SLOT_NO to be the hash
-   table bucket that contains (or would contain) the label's record.  If the
-   record is already in the table, set ENTRY to point to it.  Otherwise,
-   set ENTRY to be NULL. */
+/* Return a hash of NAME (FNV-1a, with a final mix so that the low-order
+   bits, which select the slot, depend on every character). */
 
-static void
-get_hash (char *name, int *slot_no, label **entry)
+static unsigned int
+hash_name (char *name)
+{
+  unsigned int h = 2166136261u;
+
+  for (; *name != '\0'; name++)
+    h = (h ^ (unsigned char) *name) * 16777619u;
+
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return (h);
+}
+
+
+/* Return the slot in the table that holds the label named NAME, whose
+   hash is HASH, or the empty slot where it would be added. */
+
+static int
+find_slot (char *name, unsigned int hash)
 {
-  int hi;
+  int mask = label_table_size - 1;
   int i;
-  label *lab;
-  int len;
 
-  /* Compute length of name in len.  */
-  for (len = 0; name[len]; len++) ;
+  for (i = hash & mask; label_table [i] != NULL; i = (i + 1) & mask)
+    if (label_hashes [i] == hash && streq (label_table [i]->name, name))
+      break;
+  return (i);
+}
+
 
-  /* Compute hash code */
-  hi = len;
-  for (i = 0; i < len; i++)
-    hi = ((hi * 613) + (unsigned)(name[i]));
+/* Double the size of the table (or allocate it) and rehash its
+   labels. */
 
-  hi &= (1 << HASHBITS) - 1;
-  hi %= LABEL_HASH_TABLE_SIZE;
+static void
+grow_label_table ()
+{
+  label **old_table = label_table;
+  unsigned int *old_hashes = label_hashes;
+  int old_size = label_table_size;
+  int i;
 
-  *slot_no = hi;
-  /* Search table for entry */
-  for (lab = label_hash_table [hi]; lab; lab = lab->next)
-    if (streq (lab->name, name))
+  label_table_size = (old_size == 0) ? INITIAL_LABEL_TABLE_SIZE : 2 * old_size;
+  label_table = (label **) zmalloc (label_table_size * sizeof (label *));
+  label_hashes = (unsigned int *) zmalloc (label_table_size * sizeof (unsigned int));
+
+  for (i = 0; i < old_size; i++)
+    if (old_table [i] != NULL)
       {
-	*entry = lab;		/* <-- return if found */
-	return;
+	int slot = find_slot (old_table [i]->name, old_hashes [i]);
+
+	label_table [slot] = old_table [i];
+	label_hashes [slot] = old_hashes [i];
       }
-  *entry = NULL;
+
+  if (old_table != NULL)
+    {
+      free (old_table);
+      free (old_hashes);
+    }
+}
+
+
+/* Remove the label in SLOT from the table.  Later labels in its probe
+   sequence are moved back, so no lookup passes over an empty slot. */
+
+static void
+remove_slot (int slot)
+{
+  int mask = label_table_size - 1;
+  int i = slot;
+  int j;
+
+  label_table [i] = NULL;
+  for (j = (i + 1) & mask; label_table [j] != NULL; j = (j + 1) & mask)
+    {
+      int home = label_hashes [j] & mask;
+
+      /* Move the label at J to I if I lies cyclically in [HOME, J). */
+      if ((i < j) ? (home <= i || j < home) : (home <= i && j < home))
+	{
+	  label_table [i] = label_table [j];
+	  label_hashes [i] = label_hashes [j];
+	  label_table [j] = NULL;
+	  i = j;
+	}
+    }
+  n_table_labels -= 1;
+  labels_by_address_valid = false;
+}
+
+
+/* Return a copy of NAME in the interned name storage. */
+
+static char *
+intern_name (char *name)
+{
+  int len = (int) strlen (name) + 1;
+  char *copy;
+
+  if (name_blocks == NULL || name_blocks->used + len > name_blocks->size)
+    {
+      int size = MAX (NAME_BLOCK_SIZE, len);
+      name_block *b = (name_block *) xmalloc (sizeof (name_block) + size);
+
+      b->next = name_blocks;
+      b->used = 0;
+      b->size = size;
+      name_blocks = b;
+    }
+
+  copy = name_blocks->bytes + name_blocks->used;
+  memcpy (copy, name, len);
+  name_blocks->used += len;
+  return (copy);
 }
 
 
@@ -139,12 +287,10 @@ get_hash (char *name, int *slot_no, label **entry)
 label *
 label_is_defined (char *name)
 {
-  int hi;
-  label *entry;
-
-  get_hash (name, &hi, &entry);
+  if (label_table_size == 0)
+    return (NULL);
 
-  return (entry);
+  return (label_table [find_slot (name, hash_name (name))]);
 }
 
 
@@ -154,34 +300,41 @@ label_is_defined (char *name)
 label *
 lookup_label (char *name)
 {
-  int hi;
-  label *entry, *lab;
+  unsigned int hash = hash_name (name);
+  int slot;
+  label *lab;
 
-  get_hash (name, &hi, &entry);
+  if (label_table_size == 0)
+    grow_label_table ();
 
-  if (entry != NULL)
-    return (entry);
+  slot = find_slot (name, hash);
+  if (label_table [slot] != NULL)
+    return (label_table [slot]);
 
-  /* Not found, create one, add to chain */
-  lab = (label *) xmalloc (sizeof (label));
-  lab->name = str_copy (name);
+  /* Not found, create one and add it to the table */
+  lab = (label *) arena_alloc (sizeof (label));
+  lab->name = intern_name (name);
   lab->addr = 0;
   lab->global_flag = 0;
   lab->const_flag = 0;
   lab->gp_flag = 0;
-  lab->uses = NULL;
-
-  lab->next = label_hash_table [hi];
-  label_hash_table [hi] = lab;
+  lab->n_uses = 0;
+
+  label_table [slot] = lab;
+  label_hashes [slot] = hash;
+  n_table_labels += 1;
+  labels_by_address_valid = false;
+  if (2 * n_table_labels > label_table_size)
+    grow_label_table ();
   return lab;			/* <-- return if created */
 }
 
 
-/* Record that the label named NAME refers to ADDRESS.	If RESOLVE_USES is
-   true, resolve all references to it.  Return the label structure. */
+/* Record that the label named NAME refers to ADDRESS.  References to it
+   are resolved at the end of the file.  Return the label structure. */
 
 label *
-record_label (char *name, mem_addr address, int resolve_uses)
+record_label (char *name, mem_addr address)
 {
   label *l = lookup_label (name);
 
@@ -192,12 +345,7 @@ record_label (char *name, mem_addr address, int resolve_uses)
 	  yyerror ("Label is defined for the second time");
 	  return (l);
 	}
-      l->addr = address;
-    }
-
-  if (resolve_uses)
-    {
-      resolve_label_uses (l);
+      set_label_address (l, address);
     }
 
   if (!l->global_flag)
@@ -209,6 +357,17 @@ record_label (char *name, mem_addr address, int resolve_uses)
 }
 
 
+/* Set the address of label L to ADDRESS.  Code outside this file must
+   move a label through here, so the address-ordered index is rebuilt. */
+
+void
+set_label_address (label *l, mem_addr address)
+{
+  l->addr = address;
+  labels_by_address_valid = false;
+}
+
+
 /* Make the label named NAME global.  Return its symbol. */
 
 label *
@@ -226,20 +385,10 @@ make_label_global (char *name)
 void
 record_inst_uses_symbol (instruction *inst, label *sym)
 {
-  label_use *u = (label_use *) xmalloc (sizeof (label_use));
-
   if (data_dir)			/* Want to free up original instruction */
-    {
-      u->inst = copy_inst (inst);
-      u->addr = current_data_pc ();
-    }
+    record_label_use (sym, copy_inst (inst), current_data_pc ());
   else
-    {
-      u->inst = inst;
-      u->addr = current_text_pc ();
-    }
-  u->next = sym->uses;
-  sym->uses = u;
+    record_label_use (sym, inst, current_text_pc ());
 }
 
 
@@ -248,36 +397,144 @@ record_inst_uses_symbol (instruction *inst, label *sym)
 void
 record_data_uses_symbol (mem_addr location, label *sym)
 {
-  label_use *u = (label_use *) xmalloc (sizeof (label_use));
+  record_label_use (sym, NULL, location);
+}
+
+
+/* Record that INSTRUCTION at ADDR, or the data word at ADDR if INST is
+   NULL, uses SYMBOL. */
+
+void
+record_label_use (label *sym, instruction *inst, mem_addr addr)
+{
+  label_use *u;
 
-  u->inst = NULL;
-  u->addr = location;
-  u->next = sym->uses;
-  sym->uses = u;
+  if (n_label_uses == label_uses_size)
+    {
+      label_uses_size = (label_uses_size == 0) ? 256 : 2 * label_uses_size;
+      label_uses = (label_use *) realloc (label_uses,
+					  label_uses_size * sizeof (label_use));
+      if (label_uses == NULL)
+	fatal_error ("Out of memory at request for %d bytes.\n",
+		     label_uses_size * (int) sizeof (label_use));
+    }
+
+  u = &label_uses [n_label_uses++];
+  u->sym = sym;
+  u->inst = inst;
+  u->addr = addr;
+  u->seq = label_use_seq++;
+  sym->n_uses += 1;
+}
+
+
+/* Return the vector of uses that have not been resolved and set N_USES
+   to its length.  The vector changes when a use is recorded or
+   resolved. */
+
+label_use *
+recorded_label_uses (int *n_uses)
+{
+  *n_uses = n_label_uses;
+  return (label_uses);
 }
 
 
-/* Given a newly-defined LABEL, resolve the previously encountered
-   instructions and data locations that refer to the label. */
+/* Resolve the recorded uses of every label that is now defined, and keep
+   the uses of labels that are still undefined.  The uses are patched in
+   order of decreasing address, so a load or store is patched before the
+   LUI that precedes it (see resolve_a_label_sub). */
 
 void
-resolve_label_uses (label *sym)
+resolve_label_uses ()
 {
-  label_use *use;
-  label_use *next_use;
+  label_use *ready;
+  int n_ready = 0;
+  int n_kept = 0;
+  int i;
+
+  for (i = 0; i < n_label_uses; i++)
+    if (label_use_is_ready (&label_uses [i]))
+      n_ready += 1;
+  if (n_ready == 0)
+    return;
 
-  for (use = sym->uses; use != NULL; use = next_use)
+  ready = (label_use *) xmalloc (n_ready * sizeof (label_use));
+  n_ready = 0;
+  for (i = 0; i < n_label_uses; i++)
+    if (label_use_is_ready (&label_uses [i]))
+      ready [n_ready++] = label_uses [i];
+    else
+      label_uses [n_kept++] = label_uses [i];
+  n_label_uses = n_kept;
+
+  qsort (ready, n_ready, sizeof (label_use), compare_label_uses);
+
+  for (i = 0; i < n_ready; i++)
     {
-      resolve_a_label_sub (sym, use->inst, use->addr);
+      label_use *use = &ready [i];
+
+      resolve_a_label_sub (use->sym, use->inst, use->addr);
       if (use->inst != NULL && use->addr >= DATA_BOT && use->addr < stack_bot)
 	{
 	  set_mem_word (use->addr, inst_encode (use->inst));
 	  free_inst (use->inst);
 	}
-      next_use = use->next;
-      free (use);
+      use->sym->n_uses -= 1;
     }
-  sym->uses = NULL;
+  free (ready);
+}
+
+
+/* Return true if the label that U uses has been given a value. */
+
+static bool
+label_use_is_ready (label_use *u)
+{
+  return (SYMBOL_IS_DEFINED (u->sym) || u->sym->const_flag);
+}
+
+
+static int
+compare_label_uses (const void *p1, const void *p2)
+{
+  label_use *u1 = (label_use *) p1;
+  label_use *u2 = (label_use *) p2;
+
+  if (u1->addr > u2->addr)
+    return (-1);
+  else if (u1->addr < u2->addr)
+    return (1);
+  else
+    return (u2->seq - u1->seq);
+}
+
+
+/* Forget the recorded uses of SYM without resolving them.  Copies of
+   instructions made for uses in the data segment are freed. */
+
+void
+drop_label_uses (label *sym)
+{
+  int n_kept = 0;
+  int i;
+
+  if (sym->n_uses == 0)
+    return;
+
+  for (i = 0; i < n_label_uses; i++)
+    {
+      label_use *use = &label_uses [i];
+
+      if (use->sym != sym)
+	label_uses [n_kept++] = *use;
+      else if (use->inst != NULL
+	       && !(TEXT_BOT <= use->addr && use->addr < text_top)
+	       && !(K_TEXT_BOT <= use->addr && use->addr < k_text_top))
+	free_inst (use->inst);
+    }
+  n_label_uses = n_kept;
+  sym->n_uses = 0;
 }
 
 
@@ -332,6 +589,7 @@ resolve_a_label_sub (label *sym, instruction *inst, mem_addr pc)
 		  if ((value & 0xf0000000) != (pc & 0xf0000000))
 		  {
 			  error ("Target of jump differs in high-order 4 bits from instruction pc 0x%x\n", pc);
+			  parse_warning_occurred = true;
 		  }
 		  /* Drop high four bits, since they come from the PC and the
 			 low two bits since instructions are on word boundaries. */
@@ -384,6 +642,7 @@ resolve_a_label_sub (label *sym, instruction *inst, mem_addr pc)
 	    {
 	      error ("Immediate value is too large for field: ");
 	      print_inst (pc);
+	      parse_warning_occurred = true;
 	    }
 	  if (opcode_is_jump (OPCODE (inst)))
 	    SET_TARGET (inst, value); /* Don't mask so it is sign-extended */
@@ -392,41 +651,41 @@ resolve_a_label_sub (label *sym, instruction *inst, mem_addr pc)
 	  SET_ENCODING (inst, inst_encode (inst));
 	}
       else
-	error ("Resolving undefined symbol: %s\n",
-	       (EXPR (inst)->symbol == NULL) ? "" : EXPR (inst)->symbol->name);
+	{
+	  error ("Resolving undefined symbol: %s\n",
+		 (EXPR (inst)->symbol == NULL) ? "" : EXPR (inst)->symbol->name);
+	  parse_warning_occurred = true;
+	}
     }
 }
 
 
-/* Remove all local (non-global) label from the table. */
+/* Resolve the uses of labels defined in the file just assembled and
+   remove all local (non-global) label from the table. */
 
 void
 flush_local_labels (int issue_undef_warnings)
 {
   label *l;
 
+  resolve_label_uses ();
+
   for (l = local_labels; l != NULL; l = l->next_local)
     {
-      int hi;
-      label *entry, *lab, *p;
-
-      get_hash (l->name, &hi, &entry);
-
-      for (lab = label_hash_table [hi], p = NULL;
-	   lab;
-	   p = lab, lab = lab->next)
-	if (lab == entry)
-	  {
-	    if (p == NULL)
-	      label_hash_table [hi] = lab->next;
-	    else
-	      p->next = lab->next;
-	    if (issue_undef_warnings && entry->addr == 0 && !entry->const_flag)
+      int slot = find_slot (l->name, hash_name (l->name));
+      label *entry = label_table [slot];
+
+      if (entry != NULL)
+	{
+	  remove_slot (slot);
+	  if (issue_undef_warnings && entry->addr == 0 && !entry->const_flag)
+	    {
 	      error ("Warning: local symbol %s was not defined\n",
 		     entry->name);
-	    /* Can't free label since IMM_EXPR's still reference it */
-	    break;
-	  }
+	      parse_warning_occurred = true;
+	    }
+	  /* Can't free label since IMM_EXPR's still reference it */
+	}
     }
   local_labels = NULL;
 }
@@ -446,7 +705,46 @@ find_symbol_address (char *symbol)
 }
 
 
-/* Print all symbols in the table. */
+/* Sort the labels in the table by address (and undefined labels by
+   name) into LABELS_BY_ADDRESS, unless it is already up to date. */
+
+static void
+sort_labels_by_address ()
+{
+  int i;
+  int n = 0;
+
+  if (labels_by_address_valid)
+    return;
+
+  if (labels_by_address != NULL)
+    free (labels_by_address);
+  labels_by_address = (label **) xmalloc ((n_table_labels + 1) * sizeof (label *));
+  for (i = 0; i < label_table_size; i ++)
+    if (label_table [i] != NULL)
+      labels_by_address [n++] = label_table [i];
+
+  qsort (labels_by_address, n, sizeof (label *), compare_label_addrs);
+  labels_by_address_valid = true;
+}
+
+
+static int
+compare_label_addrs (const void *p1, const void *p2)
+{
+  label *l1 = *(label **) p1;
+  label *l2 = *(label **) p2;
+
+  if ((mem_addr) l1->addr < (mem_addr) l2->addr)
+    return (-1);
+  else if ((mem_addr) l1->addr > (mem_addr) l2->addr)
+    return (1);
+  else
+    return (strcmp (l1->name, l2->name));
+}
+
+
+/* Print all symbols in the table, in order of their addresses. */
 
 void
 print_symbols ()
@@ -454,10 +752,30 @@ print_symbols ()
   int i;
   label *l;
 
-  for (i = 0; i < LABEL_HASH_TABLE_SIZE; i ++)
-    for (l = label_hash_table [i]; l != NULL; l = l->next)
+  sort_labels_by_address ();
+  for (i = 0; i < n_table_labels; i ++)
+    {
+      l = labels_by_address [i];
       write_output (message_out, "%s%s at 0x%08x\n",
 		    l->global_flag ? "g\t" : "\t", l->name, l->addr);
+    }
+}
+
+
+/* Return a newly-allocated vector of all labels in the table, in order
+   of their addresses, and set N_LABELS to its length. */
+
+label **
+symbol_table_contents (int *n_labels)
+{
+  label **labels;
+
+  sort_labels_by_address ();
+  labels = (label **) xmalloc ((n_table_labels + 1) * sizeof (label *));
+  memcpy (labels, labels_by_address, n_table_labels * sizeof (label *));
+
+  *n_labels = n_table_labels;
+  return (labels);
 }
 
 
@@ -467,12 +785,11 @@ void
 print_undefined_symbols ()
 {
   int i;
-  label *l;
 
-  for (i = 0; i < LABEL_HASH_TABLE_SIZE; i ++)
-    for (l = label_hash_table [i]; l != NULL; l = l->next)
-      if (l->addr == 0)
-	write_output (message_out, "%s\n", l->name);
+  /* Undefined labels sort first. */
+  sort_labels_by_address ();
+  for (i = 0; i < n_table_labels && labels_by_address [i]->addr == 0; i ++)
+    write_output (message_out, "%s\n", labels_by_address [i]->name);
 }
 
 
@@ -490,9 +807,9 @@ undefined_symbol_string ()
   int i;
   label *l;
 
-  for (i = 0; i < LABEL_HASH_TABLE_SIZE; i ++)
-    for (l = label_hash_table[i]; l != NULL; l = l->next)
-      if (l->addr == 0)
+  sort_labels_by_address ();
+  for (i = 0; i < n_table_labels; i ++)
+    if ((l = labels_by_address [i])->addr == 0)
       {
 	int name_length = (int)strlen(l->name);
 	int after_length = string_length + name_length + 2;
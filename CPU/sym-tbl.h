@@ -33,9 +33,10 @@
 
 typedef struct lab_use
 {
+  struct lab *sym;		/* Label that is used */
   instruction *inst;		/* NULL => Data, not code */
   mem_addr addr;
-  struct lab_use *next;
+  int seq;			/* Order in which uses were recorded */
 } label_use;
 
 
@@ -48,9 +49,8 @@ typedef struct lab
   unsigned global_flag : 1;	/* Non-zero => declared global */
   unsigned gp_flag : 1;		/* Non-zero => referenced off gp */
   unsigned const_flag : 1;	/* Non-zero => constant value (in addr) */
-  struct lab *next;		/* Hash table link */
   struct lab *next_local;	/* Link in list of local labels */
-  label_use *uses;		/* List of instructions that reference */
+  int n_uses;			/* Number of unresolved uses of the */
 } label;			/* label that has not yet been defined */
 
 
@@ -61,6 +61,7 @@ typedef struct lab
 /* Exported functions: */
 
 mem_addr find_symbol_address (char *symbol);
+void drop_label_uses (label *sym);
 void flush_local_labels (int issue_undef_warnings);
 void initialize_symbol_table ();
 label *label_is_defined (char *name);
@@ -68,9 +69,13 @@ label *lookup_label (char *name);
 label *make_label_global (char *name);
 void print_symbols ();
 void print_undefined_symbols ();
-label *record_label (char *name, mem_addr address, int resolve_uses);
+label *record_label (char *name, mem_addr address);
 void record_data_uses_symbol (mem_addr location, label *sym);
 void record_inst_uses_symbol (instruction *inst, label *sym);
+void record_label_use (label *sym, instruction *inst, mem_addr addr);
+label_use *recorded_label_uses (int *n_uses);
 char *undefined_symbol_string ();
 void resolve_a_label (label *sym, instruction *inst);
-void resolve_label_uses (label *sym);
+void resolve_label_uses ();
+void set_label_address (label *l, mem_addr address);
+label **symbol_table_contents (int *n_labels);
@@ -38,18 +38,36 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
 #include <sys/types.h>
 
 #ifdef _WIN32
 #include <io.h>
 #endif
 
+/* The file syscalls call the host's POSIX routines. */
+#ifdef _WIN32
+#define host_open _open
+#define host_read _read
+#define host_write _write
+#define host_close _close
+#else
+#define host_open open
+#define host_read read
+#define host_write write
+#define host_close close
+#endif
+
 #include "spim.h"
 #include "string-stream.h"
 #include "inst.h"
 #include "reg.h"
 #include "mem.h"
 #include "sym-tbl.h"
+#include "run.h"
 #include "syscall.h"
 
 
@@ -103,161 +121,753 @@ void windowsParameterHandlingControl(int flag )
 #endif
 
 
+/* Local functions: */
+
+static void buffer_console_output (char *fmt, ...);
+static void buffer_console_string (char *str, int length);
+static void console_output_added ();
+static reg_word parse_input_int (char *str);
+static BYTE_TYPE *guest_bytes (mem_addr addr, mem_addr length, bool store);
+static BYTE_TYPE *guest_string (mem_addr addr, mem_addr *length);
+static unsigned long long monotonic_ns ();
+static void register_builtin_syscalls ();
+static int compare_syscall_cost (const void *p1, const void *p2);
+static int sys_print_int ();
+static int sys_print_float ();
+static int sys_print_double ();
+static int sys_print_string ();
+static int sys_read_int ();
+static int sys_read_float ();
+static int sys_read_double ();
+static int sys_read_string ();
+static int sys_sbrk ();
+static int sys_print_char ();
+static int sys_read_char ();
+static int sys_exit ();
+static int sys_exit2 ();
+static int sys_open ();
+static int sys_read ();
+static int sys_write ();
+static int sys_close ();
+static int sys_memcpy ();
+static int sys_memset ();
+static int sys_strlen ();
+static int sys_strcmp ();
+static int sys_memcmp ();
+static int sys_mmap ();
+static int sys_time_ns ();
+static int sys_inst_count ();
+
+
+/* Output from the print syscalls is formatted directly into this buffer
+   rather than written (and flushed) one value at a time.  The buffer is
+   handed to write_output when it fills, when it has held output for
+   CONSOLE_FLUSH_DELAY_NS (checked as output is added and periodically by
+   run_spim), and at the explicit flush points: before the program reads
+   input or does file IO, when run_program returns (exit, breakpoint, or
+   end of steps), and before an error message. */
+
+#define CONSOLE_BUFFER_SIZE	8192
+
+/* Longest text a single numeric or character print can produce. */
+#define MAX_FORMATTED_LENGTH	64
+
+#define CONSOLE_FLUSH_DELAY_NS	50000000ULL /* 50ms */
+
+static char console_buffer[CONSOLE_BUFFER_SIZE + 1];
+static int console_buffer_length = 0;
+static unsigned long long console_output_since; /* When buffer filled */
+
+
+/* Registered syscalls, indexed by the number the program puts in $v0. */
+
+typedef struct
+{
+  const char *name;
+  const char *args;		/* Argument signature, see syscall.h */
+  syscall_handler handler;	/* NULL => no such syscall */
+  unsigned long long calls;
+  unsigned long long host_ns;	/* Only while time_syscalls */
+} syscall_entry;
+
+#define SYSCALL_TABLE_SIZE	128
+
+static syscall_entry syscall_table[SYSCALL_TABLE_SIZE];
+
+static bool builtin_syscalls_registered = false;
+
+
+/* Syscalls for the source-language version of SPIM.  These are easier to
+   use than the real syscall and are portable to non-MIPS operating
+   systems. */
+
+static struct
+{
+  int number;
+  const char *name;
+  const char *args;
+  syscall_handler handler;
+} builtin_syscalls[] =
+{
+  {PRINT_INT_SYSCALL, "print_int", "i", sys_print_int},
+  {PRINT_FLOAT_SYSCALL, "print_float", "f", sys_print_float},
+  {PRINT_DOUBLE_SYSCALL, "print_double", "d", sys_print_double},
+  {PRINT_STRING_SYSCALL, "print_string", "s", sys_print_string},
+  {READ_INT_SYSCALL, "read_int", "", sys_read_int},
+  {READ_FLOAT_SYSCALL, "read_float", "", sys_read_float},
+  {READ_DOUBLE_SYSCALL, "read_double", "", sys_read_double},
+  {READ_STRING_SYSCALL, "read_string", "ai", sys_read_string},
+  {SBRK_SYSCALL, "sbrk", "i", sys_sbrk},
+  {EXIT_SYSCALL, "exit", "", sys_exit},
+  {PRINT_CHARACTER_SYSCALL, "print_char", "i", sys_print_char},
+  {READ_CHARACTER_SYSCALL, "read_char", "", sys_read_char},
+  {OPEN_SYSCALL, "open", "sii", sys_open},
+  {READ_SYSCALL, "read", "iai", sys_read},
+  {WRITE_SYSCALL, "write", "iai", sys_write},
+  {CLOSE_SYSCALL, "close", "i", sys_close},
+  {EXIT2_SYSCALL, "exit2", "i", sys_exit2},
+  {MEMCPY_SYSCALL, "memcpy", "aai", sys_memcpy},
+  {MEMSET_SYSCALL, "memset", "aii", sys_memset},
+  {STRLEN_SYSCALL, "strlen", "s", sys_strlen},
+  {STRCMP_SYSCALL, "strcmp", "ss", sys_strcmp},
+  {MEMCMP_SYSCALL, "memcmp", "aai", sys_memcmp},
+  {MMAP_SYSCALL, "mmap", "si", sys_mmap},
+  {TIME_NS_SYSCALL, "time_ns", "", sys_time_ns},
+  {INST_COUNT_SYSCALL, "inst_count", "", sys_inst_count},
+};
+
+#define BUILTIN_SYSCALLS_LEN (int) (sizeof (builtin_syscalls) / sizeof (builtin_syscalls[0]))
+
+
+/* => measure the host time spent in each syscall */
+bool time_syscalls = false;
+
+
 /* Decides which syscall to execute or simulate.  Returns zero upon
    exit syscall and non-zero to continue execution. */
 
 int
 do_syscall ()
 {
+  syscall_entry *entry;
+  unsigned long long start = 0;
+  int result;
+
+  if (!builtin_syscalls_registered)
+    register_builtin_syscalls ();
+
+  if (R[REG_V0] < 0 || R[REG_V0] >= SYSCALL_TABLE_SIZE
+      || syscall_table[R[REG_V0]].handler == NULL)
+    {
+      run_error ("Unknown system call: %d\n", R[REG_V0]);
+      return (1);
+    }
+
+  entry = &syscall_table[R[REG_V0]];
+  entry->calls += 1;
+
 #ifdef _WIN32
-    windowsParameterHandlingControl(0);
+  windowsParameterHandlingControl(0);
 #endif
+  if (time_syscalls)
+    start = monotonic_ns ();
 
-  /* Syscalls for the source-language version of SPIM.  These are easier to
-     use than the real syscall and are portable to non-MIPS operating
-     systems. */
+  result = entry->handler ();
 
-  switch (R[REG_V0])
-    {
-    case PRINT_INT_SYSCALL:
-      write_output (console_out, "%d", R[REG_A0]);
-      break;
+  if (time_syscalls)
+    entry->host_ns += monotonic_ns () - start;
+#ifdef _WIN32
+  windowsParameterHandlingControl(1);
+#endif
+  return (result);
+}
 
-    case PRINT_FLOAT_SYSCALL:
-      {
-	float val = FPR_S (REG_FA0);
 
-	write_output (console_out, "%.8f", val);
-	break;
-      }
+/* Make HANDLER the implementation of syscall NUMBER, replacing any
+   earlier one (including a built-in syscall).  NAME and ARGS are used in
+   the syscall statistics. */
 
-    case PRINT_DOUBLE_SYSCALL:
-      write_output (console_out, "%.18g", FPR[REG_FA0 / 2]);
-      break;
+void
+register_syscall (int number, const char *name, const char *args,
+		  syscall_handler handler)
+{
+  if (!builtin_syscalls_registered)
+    register_builtin_syscalls ();
+
+  if (number < 0 || number >= SYSCALL_TABLE_SIZE)
+    fatal_error ("Syscall number %d out of range (0 .. %d)\n",
+		 number, SYSCALL_TABLE_SIZE - 1);
+  syscall_table[number].name = name;
+  syscall_table[number].args = args;
+  syscall_table[number].handler = handler;
+  syscall_table[number].calls = 0;
+  syscall_table[number].host_ns = 0;
+}
 
-    case PRINT_STRING_SYSCALL:
-      write_output (console_out, "%s", mem_reference (R[REG_A0]));
-      break;
 
-    case READ_INT_SYSCALL:
-      {
-	static char str [256];
+static void
+register_builtin_syscalls ()
+{
+  int i;
 
-	read_input (str, 256);
-	R[REG_RES] = atol (str);
-	break;
-      }
+  builtin_syscalls_registered = true;
+  for (i = 0; i < BUILTIN_SYSCALLS_LEN; i++)
+    register_syscall (builtin_syscalls[i].number, builtin_syscalls[i].name,
+		      builtin_syscalls[i].args, builtin_syscalls[i].handler);
+}
 
-    case READ_FLOAT_SYSCALL:
-      {
-	static char str [256];
 
-	read_input (str, 256);
-	FPR_S (REG_FRES) = (float) atof (str);
-	break;
-      }
+/* Reset the call counts and times of all syscalls. */
 
-    case READ_DOUBLE_SYSCALL:
-      {
-	static char str [256];
+void
+clear_syscall_stats ()
+{
+  int i;
 
-	read_input (str, 256);
-	FPR [REG_FRES] = atof (str);
-	break;
-      }
+  for (i = 0; i < SYSCALL_TABLE_SIZE; i++)
+    {
+      syscall_table[i].calls = 0;
+      syscall_table[i].host_ns = 0;
+    }
+}
 
-    case READ_STRING_SYSCALL:
-      {
-	read_input ( (char *) mem_reference (R[REG_A0]), R[REG_A1]);
-	data_modified = true;
-	break;
-      }
 
-    case SBRK_SYSCALL:
+/* Print the number of calls of each syscall that was used and, if they
+   were measured, the host time spent in them, most expensive first. */
+
+void
+format_syscall_stats (str_stream *ss)
+{
+  syscall_entry *sorted[SYSCALL_TABLE_SIZE];
+  unsigned long long total = 0;
+  int n_sorted = 0;
+  int i;
+
+  for (i = 0; i < SYSCALL_TABLE_SIZE; i++)
+    if (syscall_table[i].calls != 0)
       {
-	mem_addr x = data_top;
-	expand_data (R[REG_A0]);
-	R[REG_RES] = x;
-	data_modified = true;
-	break;
+	total += syscall_table[i].calls;
+	sorted[n_sorted++] = &syscall_table[i];
       }
 
-    case PRINT_CHARACTER_SYSCALL:
-      write_output (console_out, "%c", R[REG_A0]);
-      break;
+  ss_printf (ss, "Syscalls (%llu calls):\n", total);
+  qsort (sorted, n_sorted, sizeof (syscall_entry *), compare_syscall_cost);
+  for (i = 0; i < n_sorted; i++)
+    {
+      ss_printf (ss, "  %3d %-14s %-4s %14llu", (int) (sorted[i] - syscall_table),
+		 sorted[i]->name, sorted[i]->args, sorted[i]->calls);
+      if (time_syscalls)
+	ss_printf (ss, " %12.3f ms", sorted[i]->host_ns / 1000000.0);
+      ss_printf (ss, "\n");
+    }
+}
 
-    case READ_CHARACTER_SYSCALL:
-      {
-	static char str [2];
 
-	read_input (str, 2);
-	if (*str == '\0') *str = '\n';      /* makes xspim = spim */
-	R[REG_RES] = (long) str[0];
-	break;
-      }
+/* Sort syscalls by decreasing host time, then by decreasing calls. */
 
-    case EXIT_SYSCALL:
-      spim_return_value = 0;
-      return (0);
+static int
+compare_syscall_cost (const void *p1, const void *p2)
+{
+  syscall_entry *e1 = *(syscall_entry **) p1;
+  syscall_entry *e2 = *(syscall_entry **) p2;
+
+  if (e1->host_ns != e2->host_ns)
+    return (e1->host_ns > e2->host_ns ? -1 : 1);
+  if (e1->calls != e2->calls)
+    return (e1->calls > e2->calls ? -1 : 1);
+  return (e1 < e2 ? -1 : 1);
+}
 
-    case EXIT2_SYSCALL:
-      spim_return_value = R[REG_A0];	/* value passed to spim's exit() call */
-      return (0);
 
-    case OPEN_SYSCALL:
-      {
-#ifdef _WIN32
-        R[REG_RES] = _open((char*)mem_reference (R[REG_A0]), R[REG_A1], R[REG_A2]);
-#else
-	R[REG_RES] = open((char*)mem_reference (R[REG_A0]), R[REG_A1], R[REG_A2]);
-#endif
-	break;
-      }
+/* Built-in syscalls. */
 
-    case READ_SYSCALL:
-      {
-	/* Test if address is valid */
-	(void)mem_reference (R[REG_A1] + R[REG_A2] - 1);
-#ifdef _WIN32
-	R[REG_RES] = _read(R[REG_A0], mem_reference (R[REG_A1]), R[REG_A2]);
-#else
-	R[REG_RES] = read(R[REG_A0], mem_reference (R[REG_A1]), R[REG_A2]);
-#endif
-	data_modified = true;
-	break;
-      }
+static int
+sys_print_int ()
+{
+  buffer_console_output ("%d", R[REG_A0]);
+  return (1);
+}
 
-    case WRITE_SYSCALL:
-      {
-	/* Test if address is valid */
-	(void)mem_reference (R[REG_A1] + R[REG_A2] - 1);
-#ifdef _WIN32
-	R[REG_RES] = _write(R[REG_A0], mem_reference (R[REG_A1]), R[REG_A2]);
-#else
-	R[REG_RES] = write(R[REG_A0], mem_reference (R[REG_A1]), R[REG_A2]);
-#endif
-	break;
-      }
 
-    case CLOSE_SYSCALL:
-      {
-#ifdef _WIN32
-	R[REG_RES] = _close(R[REG_A0]);
-#else
-	R[REG_RES] = close(R[REG_A0]);
-#endif
-	break;
-      }
+static int
+sys_print_float ()
+{
+  float val = FPR_S (REG_FA0);
 
-    default:
-      run_error ("Unknown system call: %d\n", R[REG_V0]);
-      break;
+  buffer_console_output ("%.8f", val);
+  return (1);
+}
+
+
+static int
+sys_print_double ()
+{
+  buffer_console_output ("%.18g", FPR[REG_FA0 / 2]);
+  return (1);
+}
+
+
+static int
+sys_print_string ()
+{
+  /* The string must end within its segment; otherwise this raises the
+     same exception as a byte load past the end. */
+  mem_addr length;
+  BYTE_TYPE *str = guest_string (R[REG_A0], &length);
+
+  if (str != NULL)
+    buffer_console_string ((char *) str, length);
+  return (1);
+}
+
+
+static int
+sys_read_int ()
+{
+  char str [256];
+
+  flush_console_output ();
+  read_input (str, 256);
+  R[REG_RES] = parse_input_int (str);
+  return (1);
+}
+
+
+static int
+sys_read_float ()
+{
+  char str [256];
+
+  flush_console_output ();
+  read_input (str, 256);
+  FPR_S (REG_FRES) = (float) strtod (str, NULL);
+  return (1);
+}
+
+
+static int
+sys_read_double ()
+{
+  char str [256];
+
+  flush_console_output ();
+  read_input (str, 256);
+  FPR [REG_FRES] = strtod (str, NULL);
+  return (1);
+}
+
+
+static int
+sys_read_string ()
+{
+  /* The buffer may be in a read-only mapped file. */
+  BYTE_TYPE *str = guest_bytes (R[REG_A0], MAX (R[REG_A1], 0), true);
+
+  if (str != NULL)
+    {
+      flush_console_output ();
+      read_input ((char *) str, R[REG_A1]);
+      data_modified = true;
+    }
+  return (1);
+}
+
+
+static int
+sys_sbrk ()
+{
+  mem_addr x = data_top;
+
+  expand_data (R[REG_A0]);
+  R[REG_RES] = x;
+  data_modified = true;
+  return (1);
+}
+
+
+static int
+sys_print_char ()
+{
+  buffer_console_output ("%c", R[REG_A0]);
+  return (1);
+}
+
+
+static int
+sys_read_char ()
+{
+  static char str [2];
+
+  flush_console_output ();
+  read_input (str, 2);
+  if (*str == '\0') *str = '\n';      /* makes xspim = spim */
+  R[REG_RES] = (long) str[0];
+  return (1);
+}
+
+
+static int
+sys_exit ()
+{
+  spim_return_value = 0;
+  return (0);
+}
+
+
+static int
+sys_exit2 ()
+{
+  spim_return_value = R[REG_A0];	/* value passed to spim's exit() call */
+  return (0);
+}
+
+
+static int
+sys_open ()
+{
+  R[REG_RES] = host_open ((char*)mem_reference (R[REG_A0]), R[REG_A1], R[REG_A2]);
+  return (1);
+}
+
+
+static int
+sys_read ()
+{
+  /* Test if address is valid */
+  (void)mem_reference (R[REG_A1] + R[REG_A2] - 1);
+  flush_console_output ();
+  R[REG_RES] = host_read (R[REG_A0], mem_reference (R[REG_A1]), R[REG_A2]);
+  data_modified = true;
+  return (1);
+}
+
+
+static int
+sys_write ()
+{
+  /* Test if address is valid */
+  (void)mem_reference (R[REG_A1] + R[REG_A2] - 1);
+  flush_console_output ();
+  R[REG_RES] = host_write (R[REG_A0], mem_reference (R[REG_A1]), R[REG_A2]);
+  return (1);
+}
+
+
+static int
+sys_close ()
+{
+  R[REG_RES] = host_close (R[REG_A0]);
+  return (1);
+}
+
+
+static int
+sys_memcpy ()
+{
+  BYTE_TYPE *dst, *src;
+
+  R[REG_RES] = R[REG_A0];
+  if (R[REG_A2] != 0
+      && (dst = guest_bytes (R[REG_A0], R[REG_A2], true)) != NULL
+      && (src = guest_bytes (R[REG_A1], R[REG_A2], false)) != NULL)
+    {
+      /* Overlapping ranges are undefined for memcpy; memmove keeps them
+	 from corrupting anything outside the destination. */
+      memmove (dst, src, R[REG_A2]);
+      data_modified = true;
+    }
+  return (1);
+}
+
+
+static int
+sys_memset ()
+{
+  BYTE_TYPE *dst;
+
+  R[REG_RES] = R[REG_A0];
+  if (R[REG_A2] != 0
+      && (dst = guest_bytes (R[REG_A0], R[REG_A2], true)) != NULL)
+    {
+      memset (dst, R[REG_A1] & 0xff, R[REG_A2]);
+      data_modified = true;
+    }
+  return (1);
+}
+
+
+static int
+sys_strlen ()
+{
+  mem_addr length;
+
+  if (guest_string (R[REG_A0], &length) != NULL)
+    R[REG_RES] = length;
+  return (1);
+}
+
+
+static int
+sys_strcmp ()
+{
+  BYTE_TYPE *s1, *s2;
+  mem_addr length;
+
+  if ((s1 = guest_string (R[REG_A0], &length)) != NULL
+      && (s2 = guest_string (R[REG_A1], &length)) != NULL)
+    {
+      int cmp = strcmp ((char *) s1, (char *) s2);
+      R[REG_RES] = (cmp > 0) - (cmp < 0);
+    }
+  return (1);
+}
+
+
+static int
+sys_memcmp ()
+{
+  BYTE_TYPE *s1, *s2;
+
+  if (R[REG_A2] == 0)
+    R[REG_RES] = 0;
+  else if ((s1 = guest_bytes (R[REG_A0], R[REG_A2], false)) != NULL
+	   && (s2 = guest_bytes (R[REG_A1], R[REG_A2], false)) != NULL)
+    {
+      int cmp = memcmp (s1, s2, R[REG_A2]);
+      R[REG_RES] = (cmp > 0) - (cmp < 0);
+    }
+  return (1);
+}
+
+
+static int
+sys_mmap ()
+{
+  mem_addr length;
+  BYTE_TYPE *name = guest_string (R[REG_A0], &length);
+
+  if (name != NULL)
+    {
+      mem_addr addr = map_file ((char *) name, R[REG_A1] == MMAP_PRIVATE_COPY,
+				&length);
+
+      R[REG_RES] = (addr == 0) ? -1 : addr;
+      R[REG_V1] = (addr == 0) ? 0 : length;
+    }
+  return (1);
+}
+
+
+static int
+sys_time_ns ()
+{
+  unsigned long long ns = monotonic_ns ();
+
+  R[REG_RES] = (reg_word) (ns & 0xffffffff);
+  R[REG_V1] = (reg_word) (ns >> 32);
+  return (1);
+}
+
+
+static int
+sys_inst_count ()
+{
+  /* Includes this syscall instruction. */
+  R[REG_RES] = (reg_word) (instructions_executed & 0xffffffff);
+  R[REG_V1] = (reg_word) (instructions_executed >> 32);
+  return (1);
+}
+
+
+/* Format one short value into the console buffer. */
+
+static void
+buffer_console_output (char *fmt, ...)
+{
+  va_list args;
+  int n;
+
+  if (CONSOLE_BUFFER_SIZE - console_buffer_length < MAX_FORMATTED_LENGTH)
+    flush_console_output ();
+
+  va_start (args, fmt);
+  n = vsnprintf (console_buffer + console_buffer_length,
+		 CONSOLE_BUFFER_SIZE - console_buffer_length, fmt, args);
+  va_end (args);
+
+  if (n > 0)
+    console_buffer_length += MIN (n, CONSOLE_BUFFER_SIZE - console_buffer_length - 1);
+  console_output_added ();
+}
+
+
+/* Copy the LENGTH bytes of the NUL-terminated string STR into the console
+   buffer.  A string that does not fit even in an empty buffer is written
+   directly. */
+
+static void
+buffer_console_string (char *str, int length)
+{
+  if (CONSOLE_BUFFER_SIZE - console_buffer_length < length)
+    {
+      flush_console_output ();
+      if (CONSOLE_BUFFER_SIZE < length)
+	{
+	  write_output (console_out, "%s", str);
+	  return;
+	}
+    }
+
+  memcpy (console_buffer + console_buffer_length, str, length);
+  console_buffer_length += length;
+  console_output_added ();
+}
+
+
+static void
+console_output_added ()
+{
+  if (console_buffer_length == 0)
+    return;
+  else if (CONSOLE_BUFFER_SIZE <= console_buffer_length)
+    flush_console_output ();
+  else if (console_output_since == 0)
+    console_output_since = monotonic_ns ();
+  else
+    check_console_output ();
+}
+
+
+/* Write the buffered console output if it has waited long enough.
+   Called periodically while the program runs, so output printed before
+   a long computation still appears. */
+
+void
+check_console_output ()
+{
+  if (console_buffer_length != 0
+      && monotonic_ns () - console_output_since >= CONSOLE_FLUSH_DELAY_NS)
+    flush_console_output ();
+}
+
+
+/* Write the buffered console output.  A NUL printed by the program (with
+   print_char) ends a %s, so it is written separately. */
+
+void
+flush_console_output ()
+{
+  char *ptr = console_buffer;
+  char *end = console_buffer + console_buffer_length;
+
+  console_output_since = 0;
+  if (console_buffer_length == 0)
+    return;
+
+  /* Empty the buffer first, so a flush from within write_output (or from
+     an error it reports) finds nothing left to write. */
+  console_buffer_length = 0;
+  *end = '\0';
+  while (ptr < end)
+    {
+      write_output (console_out, "%s", ptr);
+      ptr += strlen (ptr);
+      if (ptr < end)
+	{
+	  write_output (console_out, "%c", '\0');
+	  ptr += 1;
+	}
     }
+}
+
+
+/* Convert the line read by READ_INT_SYSCALL the way atol does (leading
+   space, optional sign, digits, saturating at the range of a 64-bit
+   long), without atol's locale and errno overhead.  The result is
+   truncated to a register. */
+
+static reg_word
+parse_input_int (char *str)
+{
+  unsigned long long val = 0;
+  const unsigned long long limit = 1ULL << 63;
+  bool negative = false;
+
+  while (isspace ((unsigned char) *str))
+    str += 1;
+  if (*str == '-' || *str == '+')
+    negative = (*str++ == '-');
+
+  for ( ; '0' <= *str && *str <= '9'; str += 1)
+    val = (val > limit / 10) ? limit : MIN (val * 10 + (*str - '0'), limit);
+
+  if (negative)
+    return ((reg_word) (0 - val));
+  else
+    return ((reg_word) MIN (val, limit - 1));
+}
+
+
+/* Return a pointer to LENGTH bytes of guest data memory starting at ADDR,
+   which are to be written if STORE.  If they are not all in one segment
+   (or, for a store, are in a read-only mapped file), raise a bus error at
+   the first bad address, as a byte loop over the range would, and return
+   NULL.  A range just below the stack grows it, as a load or store
+   would. */
+
+static BYTE_TYPE *
+guest_bytes (mem_addr addr, mem_addr length, bool store)
+{
+  BYTE_TYPE *ptr;
+  mem_addr avail;
+
+  if (addr > data_top && addr < stack_bot && addr > stack_bot - 16*K*K)
+    expand_stack (stack_bot - addr + 4);
 
+  ptr = mem_data_reference (addr, &avail, store);
+  if (ptr == NULL || avail < length)
+    {
+      RAISE_EXCEPTION (ExcCode_DBE, CP0_BadVAddr = addr + avail);
+      return (NULL);
+    }
+  return (ptr);
+}
+
+
+/* Return a pointer to the NUL-terminated guest string at ADDR and set
+   *LENGTH to its length.  If the string runs off the end of its segment,
+   raise a bus error and return NULL. */
+
+static BYTE_TYPE *
+guest_string (mem_addr addr, mem_addr *length)
+{
+  mem_addr avail;
+  BYTE_TYPE *ptr = mem_data_reference (addr, &avail, false);
+  BYTE_TYPE *end = (ptr == NULL) ? NULL : (BYTE_TYPE *) memchr (ptr, 0, avail);
+
+  if (end == NULL)
+    {
+      RAISE_EXCEPTION (ExcCode_DBE, CP0_BadVAddr = addr + avail);
+      return (NULL);
+    }
+  *length = end - ptr;
+  return (ptr);
+}
+
+
+/* Nanoseconds from an arbitrary fixed point, never going backwards. */
+
+static unsigned long long
+monotonic_ns ()
+{
 #ifdef _WIN32
-    windowsParameterHandlingControl(1);
+  return ((unsigned long long) clock () * (1000000000ULL / CLOCKS_PER_SEC));
+#else
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
 #endif
-  return (1);
 }
 
 
@@ -31,10 +31,32 @@
 */
 
 
+/* A syscall handler performs its service with the arguments in $a0-$a3
+   (and $f12) and returns zero if the program should stop, as the exit
+   syscalls do, and non-zero to continue. */
+
+typedef int (*syscall_handler) ();
+
+/* The argument signature of a registered syscall is a string with one
+   letter per argument: i (integer), a (address), s (address of a string),
+   f (single in $f12), or d (double in $f12). */
+
+
 /* Exported functions. */
 
+void check_console_output ();
+void clear_syscall_stats ();
 int do_syscall ();
+void flush_console_output ();
+void format_syscall_stats (str_stream *ss);
 void handle_exception ();
+void register_syscall (int number, const char *name, const char *args,
+		       syscall_handler handler);
+
+
+/* Exported variables. */
+
+extern bool time_syscalls;	/* => measure host time in each syscall */
 
 #define PRINT_INT_SYSCALL	1
 #define PRINT_FLOAT_SYSCALL	2
@@ -60,3 +82,27 @@ void handle_exception ();
 
 #define EXIT2_SYSCALL		17
 
+/* Host implementations of common library routines on guest memory.
+   $a0, $a1, $a2 hold the arguments in C order. */
+
+#define MEMCPY_SYSCALL		60
+#define MEMSET_SYSCALL		61
+#define STRLEN_SYSCALL		62
+#define STRCMP_SYSCALL		63
+#define MEMCMP_SYSCALL		64
+
+/* Map a file ($a0 = name, $a1 = MMAP_READ_ONLY or MMAP_PRIVATE_COPY) into
+   memory.  Returns its address in $v0 (-1 on failure) and its length in
+   $v1. */
+
+#define MMAP_SYSCALL		65
+
+#define MMAP_READ_ONLY		0
+#define MMAP_PRIVATE_COPY	1
+
+/* 64-bit counters, returned with the low word in $v0 and the high word in
+   $v1: host monotonic time in nanoseconds, and instructions executed. */
+
+#define TIME_NS_SYSCALL		66
+#define INST_COUNT_SYSCALL	67
+
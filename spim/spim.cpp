@@ -39,6 +39,9 @@
 #include <setjmp.h>
 #include <signal.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
 
 
 #ifdef RS
@@ -58,6 +61,7 @@
 
 #ifndef WIN32
 #include <sys/time.h>
+#include <sys/resource.h>
 #ifdef NEED_TERMIOS
 #include <sys/ioctl.h>
 #include <sgtty.h>
@@ -79,12 +83,25 @@
 #include "scanner.h"
 #include "parser_yacc.h"
 #include "data.h"
+#include "run.h"
+#include "stats.h"
+#include "image.h"
+#include "syscall.h"
 
 
 /* Internal functions: */
 
 static void console_to_program ();
 static void console_to_spim ();
+static int fill_console_in_buffer ();
+static void redirect_console_input (char *file_name);
+static void start_console_io ();
+static void stop_console_io ();
+static void *console_io_loop (void * /*arg*/);
+static void drain_console_io ();
+static void put_console_ring (char *str, int n);
+static void wake_console_io ();
+static void write_console_ring ();
 static void control_c_seen (int /*arg*/);
 static void flush_to_newline ();
 static int get_opt_int ();
@@ -92,8 +109,11 @@ static bool parse_spim_command (bool redo);
 static void print_reg (int reg_no);
 static int print_fp_reg (int reg_no);
 static int print_reg_from_string (char *reg);
+static double elapsed_ms ();
+static void print_run_stats (double startup_ms, double run_ms);
 static void print_all_regs (int hex_flag);
 static int read_assembly_command ();
+static char *read_opt_condition ();
 static int str_prefix (char *s1, char *s2, int min_match);
 static void top_level ();
 static int read_token ();
@@ -130,10 +150,49 @@ static struct sgttyb saved_console_state;
 #else
 static struct termios saved_console_state;
 #endif
+
+/* Console input not yet consumed by read_input or get_console_char.  When
+   console input comes from a file, the buffer is the whole file, mapped
+   into memory, and the terminal is never touched. */
+#define CONSOLE_IN_BUFFER_SIZE 8192
+static char console_in_chars[CONSOLE_IN_BUFFER_SIZE];
+static char *console_in_buffer = console_in_chars;
+static int console_in_next = 0;
+static int console_in_end = 0;
+static bool console_in_mapped = false;
+
+/* With memory-mapped IO on the terminal, a separate thread does the
+   terminal IO while the program runs.  It reads characters into
+   console_in_ring and writes out the characters in console_out_ring, so
+   the receiver and transmitter devices only look at the rings and the
+   simulation makes no system calls for them.  Each ring has a single
+   producer and a single consumer, so it needs no lock.  The thread
+   sleeps in select until there is input, or until the simulation thread
+   queues output after the thread announced (in console_io_waiting) that
+   it is going to sleep and wakes it through console_io_wake_pipe. */
+#define CONSOLE_RING_SIZE 4096	/* Must be a power of 2 */
+
+typedef struct
+{
+  std::atomic<unsigned> head;	/* Next slot to fill, moved by producer */
+  std::atomic<unsigned> tail;	/* Next slot to empty, moved by consumer */
+  char data[CONSOLE_RING_SIZE];
+} console_ring;
+
+static console_ring console_in_ring;
+static console_ring console_out_ring;
+static pthread_t console_io_thread;
+static bool console_io_running = false;
+static int console_io_wake_pipe[2] = {-1, -1};
+static std::atomic<bool> console_io_stopping;
+static std::atomic<bool> console_io_waiting;
+static std::atomic<unsigned> console_out_written; /* Ring position written */
+
 static int program_argc;
 static char** program_argv;
 static bool dump_user_segments = false;
 static bool dump_all_segments = false;
+static bool print_stats = false;
 
 int
 main (int argc, char **argv)
@@ -141,6 +200,7 @@ main (int argc, char **argv)
   int i;
   bool assembly_file_loaded = false;
   int print_usage_msg = 0;
+  double start_time = elapsed_ms ();
 
   console_out.f = stdout;
   message_out.f = stdout;
@@ -210,6 +270,19 @@ main (int argc, char **argv)
       else if (streq (argv [i], "-nomapped_io")
          || streq (argv [i], "-nmio"))
   { mapped_io = false; }
+      else if (streq (argv [i], "-console_in")
+         || streq (argv [i], "-ci"))
+  { redirect_console_input (argv[++i]); }
+      else if (streq (argv [i], "-console_out")
+         || streq (argv [i], "-co"))
+  {
+    console_out.f = fopen (argv[++i], "w");
+    if (console_out.f == NULL)
+      {
+        error ("Cannot open console output file: `%s'\n", argv[i]);
+        exit (-1);
+      }
+  }
       else if (streq (argv [i], "-pseudo")
          || streq (argv [i], "-p"))
   { accept_pseudo_insts = true; }
@@ -273,7 +346,7 @@ main (int argc, char **argv)
           initialize_world (load_exception_handler ? exception_file_name : NULL, true);
           initialize_run_stack (program_argc, program_argv);
       }
-    assembly_file_loaded = read_assembly_file (argv[++i]) || assembly_file_loaded;
+    assembly_file_loaded = read_assembly_file (argv[++i], NULL) || assembly_file_loaded;
     break;
   }
       else if (streq (argv [i], "-assemble"))
@@ -282,6 +355,8 @@ main (int argc, char **argv)
         { dump_user_segments = true; }
       else if (streq (argv [i], "-full_dump"))
         { dump_all_segments = true; }
+      else if (streq (argv [i], "-stats"))
+        { print_stats = true; time_syscalls = true; }
       else
   {
     error ("\nUnknown argument: %s (ignored)\n", argv[i]);
@@ -303,10 +378,13 @@ main (int argc, char **argv)
   -noquiet		Print warnings (default)\n\
   -mapped_io		Enable memory-mapped IO\n\
   -nomapped_io		Do not enable memory-mapped IO (default)\n\
-  -file <file> <args>	Assembly code file and arguments to program\n\
-  -assemble		Write assembled code to standard output\n\
+  -console_in <file>	Read the program's console input from <file>\n\
+  -console_out <file>	Write the program's console output to <file>\n\
+  -file <file> <args>	Assembly code file, program image, or MIPS32 ELF executable and arguments to program\n\
+  -assemble		Write a program image of the assembled code to <file>.out\n\
   -dump			Write user data and text segments into files\n\
-  -full_dump		Write user and kernel data and text into files.\n");
+  -full_dump		Write user and kernel data and text into files.\n\
+  -stats			Report instructions executed, instruction mix, syscalls, time and peak memory on exit\n");
     }
 
 
@@ -335,6 +413,7 @@ main (int argc, char **argv)
      else
        {
          bool continuable;
+         static double run_start_time;
          console_to_program ();
          initialize_run_stack (program_argc, program_argv);
          if (!setjmp (spim_top_level_env))
@@ -347,9 +426,12 @@ main (int argc, char **argv)
                  write_output (message_out, "\n");
                  free (undefs);
                }
-             run_program (find_symbol_address (DEFAULT_RUN_LOCATION), DEFAULT_RUN_STEPS, false, false, &continuable);
+             run_start_time = elapsed_ms ();
+             run_program (starting_address (), DEFAULT_RUN_STEPS, false, false, &continuable);
            }
          console_to_spim ();
+         if (print_stats)
+           print_run_stats (run_start_time - start_time, elapsed_ms () - run_start_time);
        }
     }
 
@@ -386,6 +468,7 @@ static void
 control_c_seen (int /*arg*/)
 {
   console_to_spim ();
+  flush_console_output ();
   write_output (message_out, "\nExecution interrupted\n");
   longjmp (spim_top_level_env, 1);
 }
@@ -410,7 +493,10 @@ enum {
   CONTINUE_CMD,
   SET_BKPT_CMD,
   DELETE_BKPT_CMD,
+  CONDITION_BKPT_CMD,
+  IGNORE_BKPT_CMD,
   LIST_BKPT_CMD,
+  STATS_CMD,
   DUMPNATIVE_TEXT_CMD,
   DUMP_TEXT_CMD
 };
@@ -441,8 +527,11 @@ parse_spim_command (bool redo)
   if (!redo) flush_to_newline ();
   if (token == Y_STR)
     {
-      read_assembly_file ((char *) yylval.p);
-        pop_scanner();
+      bool scanned;
+
+      read_assembly_file ((char *) yylval.p, &scanned);
+      if (scanned)
+        pop_scanner();	/* Binary and cached files are not scanned */
     }
   else
     error ("Must supply a filename to read\n");
@@ -607,7 +696,7 @@ parse_spim_command (bool redo)
       write_output (message_out, "exit  -- Exit the simulator\n");
       write_output (message_out, "quit  -- Exit the simulator\n");
       write_output (message_out,
-        "read \"FILE\" -- Read FILE containing assembly code into memory\n");
+        "read \"FILE\" -- Read FILE containing assembly code, a program image, or an ELF executable into memory\n");
       write_output (message_out,
         "load \"FILE\" -- Same as read\n");
       write_output (message_out,
@@ -631,9 +720,19 @@ parse_spim_command (bool redo)
         "reinitialize -- Clear the memory and registers\n");
       write_output (message_out,
         "breakpoint <ADDR> -- Set a breakpoint at address ADDR\n");
+      write_output (message_out,
+        "breakpoint <ADDR> \"COND\" -- Set a breakpoint that stops only when COND is true\n");
+      write_output (message_out,
+        "condition <ADDR> [ \"COND\" ] -- Set or clear the condition of breakpoint at ADDR\n");
+      write_output (message_out,
+        "  COND is an expression over registers and memory, e.g. \"$t0 == 5 && mem[$sp+4] > 0\"\n");
+      write_output (message_out,
+        "ignore <ADDR> <N> -- Skip the next N stops at breakpoint at ADDR\n");
       write_output (message_out,
         "delete <ADDR> -- Delete breakpoint at address ADDR\n");
       write_output (message_out, "list -- List all breakpoints\n");
+      write_output (message_out,
+        "stats -- Print the instruction mix and syscalls executed so far\n");
       write_output (message_out, "dump [ \"FILE\" ] -- Dump binary code to spim.dump or FILE in network byte order\n");
       write_output (message_out, "dumpnative [ \"FILE\" ] -- Dump binary code to spim.dump or FILE in host byte order\n");
       write_output (message_out,
@@ -653,19 +752,68 @@ parse_spim_command (bool redo)
   int token = (redo ? prev_token : read_token ());
   static mem_addr addr;
 
-  if (!redo) flush_to_newline ();
+  char *condition = NULL;
+
   if (token == Y_INT)
     addr = redo ? addr + 4 : (mem_addr)yylval.i;
   else if (token == Y_ID)
     addr = redo ? addr + 4 : find_symbol_address ((char *) yylval.p);
   else
     error ("Must supply an address for breakpoint\n");
+  if (!redo && token != Y_NL)
+    condition = read_opt_condition ();
   if (cmd == SET_BKPT_CMD)
-    add_breakpoint (addr);
+    {
+      add_breakpoint (addr);
+      if (condition != NULL && !set_breakpoint_condition (addr, condition))
+        delete_breakpoint (addr);
+    }
   else
     delete_breakpoint (addr);
+  free (condition);
   prev_cmd = cmd;
 
+  return (0);
+      }
+
+    case CONDITION_BKPT_CMD:
+      {
+  int token = read_token ();
+  mem_addr addr = 0;
+  char *condition = NULL;
+
+  if (token == Y_INT)
+    addr = (mem_addr)yylval.i;
+  else if (token == Y_ID)
+    addr = find_symbol_address ((char *) yylval.p);
+  if (token != Y_NL)
+    condition = read_opt_condition ();
+  if (token == Y_INT || token == Y_ID)
+    set_breakpoint_condition (addr, condition);
+  else
+    error ("Must supply an address for breakpoint\n");
+  free (condition);
+  prev_cmd = NOP_CMD;
+  return (0);
+      }
+
+    case IGNORE_BKPT_CMD:
+      {
+  int token = read_token ();
+  mem_addr addr = 0;
+
+  if (token == Y_INT)
+    addr = (mem_addr)yylval.i;
+  else if (token == Y_ID)
+    addr = find_symbol_address ((char *) yylval.p);
+  if (token == Y_INT || token == Y_ID)
+    set_breakpoint_ignore_count (addr, get_opt_int ());
+  else
+    {
+      if (token != Y_NL) flush_to_newline ();
+      error ("Must supply an address for breakpoint\n");
+    }
+  prev_cmd = NOP_CMD;
   return (0);
       }
 
@@ -675,6 +823,19 @@ parse_spim_command (bool redo)
       prev_cmd = LIST_BKPT_CMD;
       return (0);
 
+    case STATS_CMD:
+      {
+  static str_stream ss;
+
+  if (!redo) flush_to_newline ();
+  ss_clear (&ss);
+  format_opcode_stats (&ss);
+  format_syscall_stats (&ss);
+  write_output (message_out, "%s", ss_to_string (&ss));
+  prev_cmd = NOP_CMD;
+  return (0);
+      }
+
     case DUMPNATIVE_TEXT_CMD:
     case DUMP_TEXT_CMD:
       {
@@ -765,6 +926,8 @@ read_assembly_command ()
     return (READ_CMD);
   else if (str_prefix ((char *) yylval.p, "reinitialize", 6))
     return (REINITIALIZE_CMD);
+  else if (str_prefix ((char *) yylval.p, "stats", 3))
+    return (STATS_CMD);
   else if (str_prefix ((char *) yylval.p, "step", 1))
     return (STEP_CMD);
   else if (str_prefix ((char *) yylval.p, "help", 1))
@@ -775,6 +938,10 @@ read_assembly_command ()
     return (SET_BKPT_CMD);
   else if (str_prefix ((char *) yylval.p, "delete", 1))
     return (DELETE_BKPT_CMD);
+  else if (str_prefix ((char *) yylval.p, "condition", 4))
+    return (CONDITION_BKPT_CMD);
+  else if (str_prefix ((char *) yylval.p, "ignore", 2))
+    return (IGNORE_BKPT_CMD);
   else if (str_prefix ((char *) yylval.p, "list", 2))
     return (LIST_BKPT_CMD);
   else if (str_prefix ((char *) yylval.p, "dumpnative", 5))
@@ -833,6 +1000,24 @@ flush_to_newline ()
 }
 
 
+/* Read an optional quoted breakpoint condition from the current line of
+   input and flush the rest of the line, including the newline.  Return a
+   copy of the condition or NULL if there is none. */
+
+static char *
+read_opt_condition ()
+{
+  int token = read_token ();
+  char *condition = NULL;
+
+  if (token == Y_STR)
+    condition = str_copy ((char *) yylval.p);
+  if (token != Y_NL)
+    flush_to_newline ();
+  return (condition);
+}
+
+
 /* Print register number N. */
 
 static void
@@ -852,6 +1037,43 @@ print_fp_reg (int reg_no)
 }
 
 
+/* Return the current time in milliseconds, from an arbitrary origin. */
+
+static double
+elapsed_ms ()
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0);
+}
+
+
+/* Report, on stderr, the instructions executed, the time to start up
+   (initialize, assemble, and load) and to run the program, and the peak
+   memory use.  Printed as KEY=VALUE pairs on one line, for scripts, and
+   followed by the instruction mix and syscall counts and times. */
+
+static void
+print_run_stats (double startup_ms, double run_ms)
+{
+  struct rusage usage;
+  double mips = (run_ms > 0 ? instructions_executed / (run_ms * 1000.0) : 0.0);
+
+  str_stream ss;
+
+  getrusage (RUSAGE_SELF, &usage);
+  fprintf (stderr,
+	   "spim-stats: instructions=%llu startup_ms=%.3f run_ms=%.3f mips=%.3f peak_rss_kb=%ld\n",
+	   instructions_executed, startup_ms, run_ms, mips, (long) usage.ru_maxrss);
+
+  ss_init (&ss);
+  format_opcode_stats (&ss);
+  format_syscall_stats (&ss);
+  fputs (ss_to_string (&ss), stderr);
+}
+
+
 static int
 print_reg_from_string (char* reg_num)
 {
@@ -902,6 +1124,10 @@ print_all_regs (int hex_flag)
 }
 
 
+/* Write the assembled program as a program image in PROGRAM_NAME.out,
+   which can be read back without assembling it.  Return true if an
+   error occurred. */
+
 static bool
 write_assembled_code(char* program_name)
 {
@@ -910,62 +1136,16 @@ write_assembled_code(char* program_name)
       return (parse_error_occurred);
     }
 
-  FILE *fp = NULL;
   char *filename = NULL;
-
-  mem_addr addr;
-  mem_addr dump_start;
-  mem_addr dump_end;
+  bool ok;
 
   filename = (char*) xmalloc(strlen(program_name) + 5);
   strcpy(filename, program_name);
   strcat(filename, ".out");
 
-  fp = fopen (filename, "wt");
-  if (fp == NULL)
-    {
-      perror (filename);
-      return (true);
-    }
-
-  /* dump text segment */
-  user_kernel_text_segment (false);
-  dump_start = find_symbol_address (END_OF_TRAP_HANDLER_SYMBOL);
-  dump_end = current_text_pc ();
-
-  (void)fprintf (fp, ".text # 0x%x .. 0x%x\n.word ", dump_start, dump_end);
-  for (addr = dump_start; addr < dump_end; addr += BYTES_PER_WORD)
-    {
-      int32 code = inst_encode (read_mem_inst (addr));
-      (void)fprintf (fp, "0x%x%s", code, addr != (dump_end - BYTES_PER_WORD) ? ", " : "");
-    }
-  (void)fprintf (fp, "\n");
-
-  /* dump data segment */
-  user_kernel_data_segment (false);
-  if (bare_machine)
-    {
-      dump_start = 0;
-    }
-    else
-    {
-        dump_start = DATA_BOT;
-    }
-  dump_end = current_data_pc ();
-
-  if (dump_end > dump_start)
-    {
-      (void)fprintf (fp, ".data # 0x%x .. 0x%x\n.word ", dump_start, dump_end);
-      for (addr = dump_start; addr < dump_end; addr += BYTES_PER_WORD)
-        {
-          int32 code = read_mem_word (addr);
-          (void)fprintf (fp, "0x%x%s", code, addr != (dump_end - BYTES_PER_WORD) ? ", " : "");
-        }
-      (void)fprintf (fp, "\n");
-    }
-
-  fclose (fp);
-  return (false);
+  ok = write_program_image (filename);
+  free (filename);
+  return (!ok);
 }
 
 
@@ -978,6 +1158,8 @@ error (char *fmt, ...)
   va_list args;
 
   va_start (args, fmt);
+  flush_console_output ();
+  drain_console_io ();
 
 #ifdef NEED_VFPRINTF
   _doprnt (fmt, args, stderr);
@@ -996,6 +1178,8 @@ fatal_error (char *fmt, ...)
   va_list args;
   va_start (args, fmt);
   fmt = va_arg (args, char *);
+  flush_console_output ();
+  drain_console_io ();
 
 #ifdef NEED_VFPRINTF
   _doprnt (fmt, args, stderr);
@@ -1016,6 +1200,7 @@ run_error (char *fmt, ...)
   va_start (args, fmt);
 
   console_to_spim ();
+  flush_console_output ();
 
 #ifdef NEED_VFPRINTF
   _doprnt (fmt, args, stderr);
@@ -1035,18 +1220,33 @@ write_output (port fp, char *fmt, ...)
 {
   va_list args;
   FILE *f;
-  int restore_console_to_program = 0;
 
   va_start (args, fmt);
   f = fp.f;
 
-  if (console_state_saved)
+  if (console_io_running && (f == 0 ? stdout : f) == console_out.f)
     {
-      restore_console_to_program = 1;
-      console_to_spim ();
+      /* The IO thread owns the console while the program runs, so queue
+	 the text behind the program's own output. */
+      char buf[1024];
+      char *str = buf;
+      va_list args_copy;
+      int n;
+
+      va_copy (args_copy, args);
+      n = vsnprintf (buf, sizeof (buf), fmt, args_copy);
+      va_end (args_copy);
+      if (n >= (int) sizeof (buf))
+	{
+	  str = (char *) xmalloc (n + 1);
+	  vsnprintf (str, n + 1, fmt, args);
+	}
+      if (n > 0)
+	put_console_ring (str, n);
+      if (str != buf)
+	free (str);
     }
-
-  if (f != 0)
+  else if (f != 0)
     {
 #ifdef NEED_VFPRINTF
       _doprnt (fmt, args, f);
@@ -1065,9 +1265,6 @@ write_output (port fp, char *fmt, ...)
       fflush (stdout);
     }
   va_end (args);
-
-  if (restore_console_to_program)
-    console_to_program ();
 }
 
 
@@ -1079,25 +1276,38 @@ read_input (char *str, int str_size)
   char *ptr;
   int restore_console_to_program = 0;
 
-  if (console_state_saved)
-    {
-      restore_console_to_program = 1;
-      console_to_spim ();
-    }
-
   ptr = str;
 
   while (1 < str_size)		/* Reserve space for null */
     {
-      char buf[1];
-      if (read ((int) console_in.i, buf, 1) <= 0) /* Not in raw mode! */
+      char *start, *nl;
+      int n;
+
+      if (console_in_next == console_in_end && fill_console_in_buffer () == 0)
+	{
+	  /* Nothing is buffered, so the line must be read from the
+	     terminal, which needs its normal (echoing, line-editing) mode. */
+	  if (!console_state_saved)
+	    break;
+	  restore_console_to_program = 1;
+	  console_to_spim ();
+	  if (fill_console_in_buffer () == 0)
+	    break;
+	}
+
+      start = console_in_buffer + console_in_next;
+      n = MIN (console_in_end - console_in_next, str_size - 1);
+      nl = (char *) memchr (start, '\n', n);
+      if (nl != NULL)
+        n = nl - start + 1;
+
+      memcpy (ptr, start, n);
+      ptr += n;
+      str_size -= n;
+      console_in_next += n;
+
+      if (nl != NULL)
         break;
-
-      *ptr ++ = buf[0];
-      str_size -= 1;
-
-      if (buf[0] == '\n')
-  break;
     }
 
   if (0 < str_size)
@@ -1108,18 +1318,292 @@ read_input (char *str, int str_size)
 }
 
 
-/* Give the console to the program for IO. */
+/* Add character C to RING.  Return false if RING is full.  Only the
+   ring's producer may call this. */
+
+static bool
+ring_put (console_ring *ring, char c)
+{
+  unsigned head = ring->head.load (std::memory_order_relaxed);
+
+  if (head - ring->tail.load (std::memory_order_acquire) == CONSOLE_RING_SIZE)
+    return (false);
+  ring->data[head & (CONSOLE_RING_SIZE - 1)] = c;
+  ring->head.store (head + 1, std::memory_order_release);
+  return (true);
+}
+
+
+/* Remove the oldest character in RING into *C.  Return false if RING is
+   empty.  Only the ring's consumer may call this. */
+
+static bool
+ring_get (console_ring *ring, char *c)
+{
+  unsigned tail = ring->tail.load (std::memory_order_relaxed);
+
+  if (ring->head.load (std::memory_order_acquire) == tail)
+    return (false);
+  *c = ring->data[tail & (CONSOLE_RING_SIZE - 1)];
+  ring->tail.store (tail + 1, std::memory_order_release);
+  return (true);
+}
+
+
+/* Return the number of characters in RING. */
+
+static unsigned
+ring_count (console_ring *ring)
+{
+  return (ring->head.load (std::memory_order_acquire)
+	  - ring->tail.load (std::memory_order_acquire));
+}
+
+
+/* Refill the console input buffer with a single read.  A terminal in
+   canonical mode returns at most one line per read, so interactive input
+   still arrives a line at a time.  Return the number of bytes read. */
+
+static int
+fill_console_in_buffer ()
+{
+  int n = 0;
+  char c;
+
+  if (console_in_mapped)
+    return (0);			/* End of the input file */
+
+  /* Characters the IO thread has read come before any still unread. */
+  while (n < CONSOLE_IN_BUFFER_SIZE && ring_get (&console_in_ring, &c))
+    console_in_buffer[n++] = c;
+  if (n == 0 && !console_io_running)
+    n = read ((int) console_in.i, console_in_buffer, CONSOLE_IN_BUFFER_SIZE);
+
+  console_in_next = 0;
+  console_in_end = (n > 0) ? n : 0;
+  return (console_in_end);
+}
+
+
+/* Take console input from the file FILE_NAME instead of the terminal. */
+
+static void
+redirect_console_input (char *file_name)
+{
+  int length;
+  char *text = map_input_file (file_name, &length);
+
+  if (text == NULL)
+    {
+      error ("Cannot open console input file: `%s'\n", file_name);
+      exit (-1);
+    }
+  console_in_buffer = text;
+  console_in_next = 0;
+  console_in_end = length;
+  console_in_mapped = true;
+}
+
+
+/* Start the thread that does terminal IO for the memory-mapped devices.
+   If the thread cannot be started, the devices poll the terminal
+   directly. */
+
+static void
+start_console_io ()
+{
+  sigset_t block, old;
+
+  if (console_io_running || !mapped_io || console_in_mapped)
+    return;
+  if (console_io_wake_pipe[0] < 0 && pipe (console_io_wake_pipe) != 0)
+    return;
+  console_io_stopping.store (false);
+  console_io_waiting.store (false);
+  console_out_written.store (console_out_ring.head.load ());
+
+  /* ^C must be handled by the simulation thread, which the new thread
+     inherits this mask from. */
+  sigemptyset (&block);
+  sigaddset (&block, SIGINT);
+  pthread_sigmask (SIG_BLOCK, &block, &old);
+  console_io_running =
+    (pthread_create (&console_io_thread, NULL, console_io_loop, NULL) == 0);
+  pthread_sigmask (SIG_SETMASK, &old, NULL);
+}
+
+
+/* Stop the terminal IO thread after it writes out any pending output.
+   Input it has read but the program has not consumed stays in
+   console_in_ring. */
+
+static void
+stop_console_io ()
+{
+  char c = 0;
+
+  if (!console_io_running)
+    return;
+
+  console_io_stopping.store (true);
+  if (write (console_io_wake_pipe[1], &c, 1) == 1)
+    pthread_join (console_io_thread, NULL);
+  console_io_running = false;
+}
+
+
+/* Body of the terminal IO thread.  It writes out queued output, then
+   sleeps until there is terminal input or it is woken.  When
+   console_in_ring is full, it cannot read and instead checks every 10ms
+   for the program to make room. */
+
+static void *
+console_io_loop (void * /*arg*/)
+{
+  int in_fd = (int) console_in.i;
+  int wake_fd = console_io_wake_pipe[0];
+  bool input_eof = false;
+
+  while (!console_io_stopping.load ())
+    {
+      fd_set fdset;
+      struct timeval timeout;
+      unsigned room = CONSOLE_RING_SIZE - ring_count (&console_in_ring);
+      int ready;
+
+      write_console_ring ();
+
+      /* Announce the sleep, then look for output once more: either this
+	 sees output queued before the announcement, or wake_console_io
+	 sees the announcement. */
+      console_io_waiting.store (true);
+      std::atomic_thread_fence (std::memory_order_seq_cst);
+      if (ring_count (&console_out_ring) != 0)
+	{
+	  console_io_waiting.store (false);
+	  continue;
+	}
+
+      FD_ZERO (&fdset);
+      FD_SET (wake_fd, &fdset);
+      if (!input_eof && room > 0)
+	FD_SET (in_fd, &fdset);
+      timeout.tv_sec = 0;
+      timeout.tv_usec = 10000;
+      ready = select (MAX (in_fd, wake_fd) + 1, &fdset, NULL, NULL,
+		      room > 0 ? NULL : &timeout);
+      console_io_waiting.store (false);
+
+      if (ready > 0 && FD_ISSET (wake_fd, &fdset))
+	{
+	  char buf[64];
+
+	  if (read (wake_fd, buf, sizeof (buf)) < 0)
+	    perror ("read");
+	}
+      if (ready > 0 && FD_ISSET (in_fd, &fdset))
+	{
+	  char buf[256];
+	  int n = read (in_fd, buf, MIN (room, sizeof (buf)));
+
+	  if (n <= 0)
+	    input_eof = true;
+	  for (int i = 0; i < n; i++)
+	    ring_put (&console_in_ring, buf[i]);
+	}
+    }
+  write_console_ring ();
+  return (NULL);
+}
+
+
+/* Queue the N characters in STR for the IO thread to write out. */
+
+static void
+put_console_ring (char *str, int n)
+{
+  for (int i = 0; i < n; i++)
+    while (!ring_put (&console_out_ring, str[i]))
+      {
+	wake_console_io ();
+	sched_yield ();		/* Wait for the IO thread to catch up */
+      }
+  wake_console_io ();
+}
+
+
+/* Wake the IO thread if it is going to sleep, since output was queued. */
+
+static void
+wake_console_io ()
+{
+  char c = 0;
+
+  std::atomic_thread_fence (std::memory_order_seq_cst);
+  if (console_io_waiting.load () && console_io_waiting.exchange (false)
+      && write (console_io_wake_pipe[1], &c, 1) != 1)
+    perror ("write");
+}
+
+
+/* Wait until the IO thread has written out all queued output, so that a
+   message written directly to the terminal comes after it. */
+
+static void
+drain_console_io ()
+{
+  unsigned head;
+
+  if (!console_io_running)
+    return;
+  head = console_out_ring.head.load (std::memory_order_relaxed);
+  while (console_out_written.load (std::memory_order_acquire) != head)
+    {
+      wake_console_io ();
+      sched_yield ();
+    }
+}
+
+
+/* Write out the characters in console_out_ring. */
+
+static void
+write_console_ring ()
+{
+  char buf[256];
+  size_t n = 0;
+  char c;
+
+  while (ring_get (&console_out_ring, &c))
+    {
+      buf[n++] = c;
+      if (n == sizeof (buf))
+	{
+	  fwrite (buf, 1, n, console_out.f);
+	  n = 0;
+	}
+    }
+  if (n > 0)
+    fwrite (buf, 1, n, console_out.f);
+  fflush (console_out.f);
+  console_out_written.store (console_out_ring.tail.load (std::memory_order_relaxed),
+			     std::memory_order_release);
+}
+
+
+/* Give the console to the program for IO.  This is done once when a run
+   starts, and undone by console_to_spim when it stops. */
 
 static void
 console_to_program ()
 {
-  if (mapped_io && !console_state_saved)
+  if (mapped_io && !console_in_mapped && !console_state_saved)
     {
 #ifdef NEED_TERMIOS
       int flags;
       ioctl ((int) console_in.i, TIOCGETP, (char *) &saved_console_state);
       flags = saved_console_state.sg_flags;
-      saved_console_state.sg_flags = (flags | RAW) & ~(CRMOD|ECHO);
+      saved_console_state.sg_flags = (flags | CBREAK) & ~ECHO;
       ioctl ((int) console_in.i, TIOCSETP, (char *) &saved_console_state);
       saved_console_state.sg_flags = flags;
 #else
@@ -1129,7 +1613,8 @@ console_to_program ()
       params = saved_console_state;
       params.c_iflag &= ~(ISTRIP|INLCR|ICRNL|IGNCR|IXON|IXOFF|INPCK|BRKINT|PARMRK);
 
-      /* Translate CR -> NL to canonicalize input. */
+      /* Translate CR -> NL to canonicalize input.  Output keeps NL -> CR NL
+	 so that SPIM's own messages print correctly in this mode too. */
       params.c_iflag |= IGNBRK|IGNPAR|ICRNL;
       params.c_oflag = OPOST|ONLCR;
       params.c_cflag &= ~PARENB;
@@ -1141,6 +1626,7 @@ console_to_program ()
       tcsetattr (console_in.i, TCSANOW, &params);
 #endif
       console_state_saved = 1;
+      start_console_io ();
     }
 }
 
@@ -1150,6 +1636,7 @@ console_to_program ()
 static void
 console_to_spim ()
 {
+  stop_console_io ();
   if (mapped_io && console_state_saved)
 #ifdef NEED_TERMIOS
     ioctl ((int) console_in.i, TIOCSETP, (char *) &saved_console_state);
@@ -1166,7 +1653,11 @@ console_input_available ()
   fd_set fdset;
   struct timeval timeout;
 
-  if (mapped_io)
+  if (console_in_next < console_in_end || ring_count (&console_in_ring) > 0)
+    return (1);
+  else if (console_io_running)
+    return (0);
+  else if (mapped_io && !console_in_mapped)
     {
       timeout.tv_sec = 0;
       timeout.tv_usec = 0;
@@ -1182,9 +1673,10 @@ console_input_available ()
 char
 get_console_char ()
 {
-  char buf;
+  char buf = 0;
 
-  read ((int) console_in.i, &buf, 1);
+  if (console_in_next < console_in_end || fill_console_in_buffer () != 0)
+    buf = console_in_buffer[console_in_next++];
 
   if (buf == 3)			/* ^C */
     control_c_seen (0);
@@ -1195,8 +1687,14 @@ get_console_char ()
 void
 put_console_char (char c)
 {
-  putc (c, console_out.f);
-  fflush (console_out.f);
+  flush_console_output ();
+  if (console_io_running)
+    put_console_ring (&c, 1);
+  else
+    {
+      putc (c, console_out.f);
+      fflush (console_out.f);
+    }
 }
 
 
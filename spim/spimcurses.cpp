@@ -88,14 +88,19 @@
 #include "parser_yacc.h"
 #include "data.h"
 #include "cursespane.h"
+#include "stats.h"
+#include "syscall.h"
 
 
 /* Internal functions: */
 
 static void console_to_program ();
 static void console_to_spim ();
+static int fill_console_in_buffer ();
+static void redirect_console_input (char *file_name);
 static void control_c_seen (int /*arg*/);
 static void curses_loop();
+static void prompt_breakpoint();
 WINDOW *create_newwin(int height, int width, int starty, int startx);
 void destroy_win(WINDOW *local_win);
 std::vector<std::string> dump_instructions(mem_addr addr);
@@ -114,6 +119,7 @@ bool assemble;			/* => assemble, write to stdout and exit */
 char *exception_file_name = DEFAULT_EXCEPTION_HANDLER;
 port message_out, console_out, console_in;
 std::string tmp_console_file, tmp_message_file;
+bool keep_console_file = false;	// => console output named by --console_out
 bool mapped_io;			/* => activate memory-mapped IO */
 int pipe_out;
 int spim_return_value;		/* Value returned when spim exits */
@@ -167,6 +173,17 @@ static struct sgttyb saved_console_state;
 #else
 static struct termios saved_console_state;
 #endif
+
+/* Console input not yet consumed by read_input or get_console_char.  When
+   console input comes from a file, the buffer is the whole file, mapped
+   into memory, and the terminal is never touched. */
+#define CONSOLE_IN_BUFFER_SIZE 8192
+static char console_in_chars[CONSOLE_IN_BUFFER_SIZE];
+static char *console_in_buffer = console_in_chars;
+static int console_in_next = 0;
+static int console_in_end = 0;
+static bool console_in_mapped = false;
+
 static int program_argc;
 static char** program_argv;
 // static bool dump_user_segments = false;
@@ -185,6 +202,8 @@ int main(int argc, char **argv)
   /* Command line parameters */
   int help = 0;
   char *in_file = NULL;
+  char *console_in_file = NULL;
+  char *console_out_file = NULL;
   
   /*-------------------------------------------------------------------------
   add getopt_long parsing code here
@@ -193,7 +212,7 @@ int main(int argc, char **argv)
   /* This contains the short command line parameters list   In general
   they SHOULD match the long parameter but DONT HAVE TO
   e.g:  verbose  AND  g    */
-  char *getoptOptions = "hf:";
+  char *getoptOptions = "hf:i:o:";
   
   /* This contains the long command line parameter list, it should mostly
   match the short list                                                  */
@@ -202,6 +221,10 @@ int main(int argc, char **argv)
     {"help",           no_argument, 0, 'h'},
     
     {"file",    required_argument, 0, 'f'}, 
+
+    {"console_in",    required_argument, 0, 'i'},
+
+    {"console_out",    required_argument, 0, 'o'},
     
     {0, 0, 0, 0} /* Terminate */
   };
@@ -213,6 +236,14 @@ int main(int argc, char **argv)
         in_file = optarg;
         break;
 
+      case 'i':
+        console_in_file = optarg;
+        break;
+
+      case 'o':
+        console_out_file = optarg;
+        break;
+
       case 'h':
         help = 1;
         break;
@@ -247,10 +278,24 @@ int main(int argc, char **argv)
     // int print_usage_msg = 0;
 
     // Set up a _very_ cursed alternative to logging to stdout
-    char tcf[32] = "/tmp/spimcurses_console_XXXXXX";
-    mkstemp(tcf);
-    tmp_console_file = tcf;
+    if (console_out_file != NULL)
+    {
+        // The output pane shows this file, and it is kept after exit.
+        tmp_console_file = console_out_file;
+        keep_console_file = true;
+    }
+    else
+    {
+        char tcf[32] = "/tmp/spimcurses_console_XXXXXX";
+        mkstemp(tcf);
+        tmp_console_file = tcf;
+    }
     console_out.f = fopen(tmp_console_file.c_str(), "w+");
+    if (console_out.f == NULL)
+    {
+        fprintf(stderr, "Cannot open console output file: `%s'\n", tmp_console_file.c_str());
+        exit(1);
+    }
 
     char tmf[32] = "/tmp/spimcurses_message_XXXXXX";
     mkstemp(tmf);
@@ -268,6 +313,8 @@ int main(int argc, char **argv)
     /* Input comes directly (not through stdio): */
     console_in.i = 0;
     mapped_io = false;
+    if (console_in_file != NULL)
+        redirect_console_input(console_in_file);
 
     // write_startup_message ();
 
@@ -278,7 +325,7 @@ int main(int argc, char **argv)
     initialize_run_stack (program_argc, program_argv);
 
     // Load in the assembly file you'd like to step through
-    read_assembly_file(in_file);
+    read_assembly_file(in_file, NULL);
 
     curses_loop();
 
@@ -292,6 +339,7 @@ static void curses_loop() {
     // bool redo = false;
 
     addr = PC == 0 ? starting_address() : PC;
+    mem_addr text_start = addr;
     std::vector<std::string> inst_dump = dump_instructions(addr);
     // printf("%ld\n", inst_dump.size()); // Print length of instruction dump
 
@@ -383,6 +431,25 @@ static void curses_loop() {
             case 'n':
                 step = 1;
                 break;
+            case 'r':
+                // Run until the next breakpoint (or the program ends)
+                step = DEFAULT_RUN_STEPS;
+                break;
+            case 's':
+                {
+                    // Show the instruction mix and syscalls so far in the log pane
+                    static str_stream stats_ss;
+                    ss_clear(&stats_ss);
+                    format_opcode_stats(&stats_ss);
+                    format_syscall_stats(&stats_ss);
+                    write_output(message_out, "%s", ss_to_string(&stats_ss));
+                }
+                break;
+            case 'b':
+                prompt_breakpoint();
+                // Breakpoints change how instructions are listed
+                inst_dump = dump_instructions(text_start);
+                break;
             case 'h':
                 // TODO: WTF?
                 if (context != DATA && inst_start_x > 0)
@@ -540,14 +607,10 @@ static void curses_loop() {
                 console_to_program();
                 if(step)
                 {
-                    if(run_program (addr, 1, false, false, &continuable))
+                    if(run_program (addr, step, false, true, &continuable))
                     {
-                        // write_output (message_out, "Breakpoint encountered at 0x%08x\n", PC);
-
-                        delwin(inst_win);
-                        
-                        endwin();
-                        return;
+                        write_output (message_out, "Breakpoint encountered at 0x%08x", PC);
+                        addr = PC;
                     }
                 }
                 
@@ -626,17 +689,86 @@ static void curses_loop() {
         output_pane.refresh();
         log_pane.refresh();
 
-        mvprintw(max_row - 1, 2, "Press 'N' to advance / Use 'HJKL' to scroll / Press 'C' to switch windows / Press 'Q' to quit");
+        mvprintw(max_row - 1, 2, "Press 'N' to advance / 'R' to run / 'B' to set a breakpoint / 'S' for stats / Use 'HJKL' to scroll / Press 'C' to switch windows / Press 'Q' to quit");
     }
 
     delwin(inst_win);
     endwin();
 
     // Clean up log files.
-    remove(tmp_console_file.c_str());
+    if (!keep_console_file)
+        remove(tmp_console_file.c_str());
     remove(tmp_message_file.c_str());
 }
 
+// Ask for "ADDR [COND]" on the status line and set a breakpoint there.
+// ADDR is a number or a label; COND, if given, is compiled once and the
+// breakpoint only stops when it is true (e.g. $t0 == 5 && mem[$sp+4] > 0).
+// Giving an existing breakpoint a new condition replaces its condition;
+// giving it none deletes the breakpoint.
+static void prompt_breakpoint()
+{
+    char input[256];
+    char* prompt = "Breakpoint (ADDR [COND]): ";
+
+    move(max_row - 1, 0);
+    clrtoeol();
+    mvprintw(max_row - 1, 2, prompt);
+    echo();
+    curs_set(1);
+    getnstr(input, sizeof(input) - 1);
+    noecho();
+    curs_set(0);
+    move(max_row - 1, 0);
+    clrtoeol();
+
+    char* text = input;
+    while (isspace(*text))
+        text++;
+    if (*text == '\0')
+        return;
+
+    char* cond = text;
+    while (*cond != '\0' && !isspace(*cond))
+        cond++;
+    if (*cond != '\0')
+        *cond++ = '\0';
+    while (isspace(*cond))
+        cond++;
+
+    // Strip optional quotes, as in the spim command line
+    int cond_len = strlen(cond);
+    while (cond_len > 0 && isspace(cond[cond_len - 1]))
+        cond[--cond_len] = '\0';
+    if (cond_len >= 2 && cond[0] == '"' && cond[cond_len - 1] == '"')
+    {
+        cond[cond_len - 1] = '\0';
+        cond++;
+    }
+
+    mem_addr bkpt_addr;
+    if (isdigit(*text))
+        bkpt_addr = (mem_addr) strtoul(text, NULL, 0);
+    else
+        bkpt_addr = find_symbol_address(text);
+    if (bkpt_addr == 0)
+    {
+        write_output (message_out, "Unknown breakpoint address: %s", text);
+        return;
+    }
+
+    if (!inst_is_breakpoint(bkpt_addr))
+    {
+        add_breakpoint(bkpt_addr);
+        if (*cond != '\0' && !set_breakpoint_condition(bkpt_addr, cond))
+            delete_breakpoint(bkpt_addr);
+    }
+    else if (*cond != '\0')
+        set_breakpoint_condition(bkpt_addr, cond);
+    else
+        delete_breakpoint(bkpt_addr);
+}
+
 WINDOW* create_newwin(int height, int width, int starty, int startx)
 {
     WINDOW *local_win;
@@ -933,6 +1065,7 @@ static void
 control_c_seen (int /*arg*/)
 {
   console_to_spim ();
+  flush_console_output ();
   write_output (message_out, "\nExecution interrupted\n");
   longjmp (spim_top_level_env, 1);
 }
@@ -970,6 +1103,7 @@ error (char *fmt, ...)
   va_list args;
 
   va_start (args, fmt);
+  flush_console_output ();
 
 #ifdef NEED_VFPRINTF
   _doprnt (fmt, args, stderr);
@@ -987,6 +1121,7 @@ fatal_error (char *fmt, ...)
   va_list args;
   va_start (args, fmt);
   fmt = va_arg (args, char *);
+  flush_console_output ();
 
 #ifdef NEED_VFPRINTF
   _doprnt (fmt, args, stderr);
@@ -1009,6 +1144,7 @@ run_error (char *fmt, ...)
     va_start (args, fmt);
 
     console_to_spim ();
+    flush_console_output ();
 
 #ifdef NEED_VFPRINTF
     _doprnt (fmt, args, stderr);
@@ -1042,19 +1178,12 @@ write_output (port fp, char *fmt, ...)
 {
   va_list args;
   FILE *f;
-  int restore_console_to_program = 0;
 
   va_start (args, fmt);
   f = fp.f;
 
 //   f = fopen("Logs.txt", "w");
 
-  if (console_state_saved)
-    {
-      restore_console_to_program = 1;
-      console_to_spim ();
-    }
-
   if (f != 0)
     {
 #ifdef NEED_VFPRINTF
@@ -1075,9 +1204,6 @@ write_output (port fp, char *fmt, ...)
       fflush (stdout);
     }
   va_end (args);
-
-  if (restore_console_to_program)
-    console_to_program ();
 }
 
 
@@ -1089,25 +1215,38 @@ read_input (char *str, int str_size)
   char *ptr;
   int restore_console_to_program = 0;
 
-  if (console_state_saved)
-    {
-      restore_console_to_program = 1;
-      console_to_spim ();
-    }
-
   ptr = str;
 
   while (1 < str_size)		/* Reserve space for null */
     {
-      char buf[1];
-      if (read ((int) console_in.i, buf, 1) <= 0) /* Not in raw mode! */
-        break;
+      char *start, *nl;
+      int n;
+
+      if (console_in_next == console_in_end && fill_console_in_buffer () == 0)
+	{
+	  /* Nothing is buffered, so the line must be read from the
+	     terminal, which needs its normal (echoing, line-editing) mode. */
+	  if (!console_state_saved)
+	    break;
+	  restore_console_to_program = 1;
+	  console_to_spim ();
+	  if (fill_console_in_buffer () == 0)
+	    break;
+	}
+
+      start = console_in_buffer + console_in_next;
+      n = MIN (console_in_end - console_in_next, str_size - 1);
+      nl = (char *) memchr (start, '\n', n);
+      if (nl != NULL)
+        n = nl - start + 1;
 
-      *ptr ++ = buf[0];
-      str_size -= 1;
+      memcpy (ptr, start, n);
+      ptr += n;
+      str_size -= n;
+      console_in_next += n;
 
-      if (buf[0] == '\n')
-    break;
+      if (nl != NULL)
+        break;
     }
 
   if (0 < str_size)
@@ -1118,18 +1257,59 @@ read_input (char *str, int str_size)
 }
 
 
-/* Give the console to the program for IO. */
+/* Refill the console input buffer with a single read.  A terminal in
+   canonical mode returns at most one line per read, so interactive input
+   still arrives a line at a time.  Return the number of bytes read. */
+
+static int
+fill_console_in_buffer ()
+{
+  int n;
+
+  if (console_in_mapped)
+    return (0);			/* End of the input file */
+
+  n = read ((int) console_in.i, console_in_buffer, CONSOLE_IN_BUFFER_SIZE);
+
+  console_in_next = 0;
+  console_in_end = (n > 0) ? n : 0;
+  return (console_in_end);
+}
+
+
+/* Take console input from the file FILE_NAME instead of the terminal. */
+
+static void
+redirect_console_input (char *file_name)
+{
+  int length;
+  char *text = map_input_file (file_name, &length);
+
+  if (text == NULL)
+    {
+      error ("Cannot open console input file: `%s'\n", file_name);
+      exit (-1);
+    }
+  console_in_buffer = text;
+  console_in_next = 0;
+  console_in_end = length;
+  console_in_mapped = true;
+}
+
+
+/* Give the console to the program for IO.  This is done once when a run
+   starts, and undone by console_to_spim when it stops. */
 
 static void
 console_to_program ()
 {
-  if (mapped_io && !console_state_saved)
+  if (mapped_io && !console_in_mapped && !console_state_saved)
     {
 #ifdef NEED_TERMIOS
       int flags;
       ioctl ((int) console_in.i, TIOCGETP, (char *) &saved_console_state);
       flags = saved_console_state.sg_flags;
-      saved_console_state.sg_flags = (flags | RAW) & ~(CRMOD|ECHO);
+      saved_console_state.sg_flags = (flags | CBREAK) & ~ECHO;
       ioctl ((int) console_in.i, TIOCSETP, (char *) &saved_console_state);
       saved_console_state.sg_flags = flags;
 #else
@@ -1139,7 +1319,8 @@ console_to_program ()
       params = saved_console_state;
       params.c_iflag &= ~(ISTRIP|INLCR|ICRNL|IGNCR|IXON|IXOFF|INPCK|BRKINT|PARMRK);
 
-      /* Translate CR -> NL to canonicalize input. */
+      /* Translate CR -> NL to canonicalize input.  Output keeps NL -> CR NL
+	 so that SPIM's own messages print correctly in this mode too. */
       params.c_iflag |= IGNBRK|IGNPAR|ICRNL;
       params.c_oflag = OPOST|ONLCR;
       params.c_cflag &= ~PARENB;
@@ -1176,7 +1357,9 @@ console_input_available ()
   fd_set fdset;
   struct timeval timeout;
 
-  if (mapped_io)
+  if (console_in_next < console_in_end)
+    return (1);
+  else if (mapped_io && !console_in_mapped)
     {
       timeout.tv_sec = 0;
       timeout.tv_usec = 0;
@@ -1192,9 +1375,10 @@ console_input_available ()
 char
 get_console_char ()
 {
-  char buf;
+  char buf = 0;
 
-  read ((int) console_in.i, &buf, 1);
+  if (console_in_next < console_in_end || fill_console_in_buffer () != 0)
+    buf = console_in_buffer[console_in_next++];
 
   if (buf == 3)			/* ^C */
     control_c_seen (0);
@@ -1205,6 +1389,7 @@ get_console_char ()
 void
 put_console_char (char c)
 {
+  flush_console_output ();
   putc (c, console_out.f);
   fflush (console_out.f);
 }